@@ -0,0 +1,26 @@
+#pragma once
+
+#include "InpaintingEngine.hpp"
+
+namespace inpainting
+{
+	// Fills the holes with cv::inpaint (Telea's fast marching or Navier-Stokes) on the region
+	// around them. Cheap, but smooth instead of textured and without any temporal state.
+	class FastInpainter : public InpaintingEngine
+	{
+	public:
+		explicit FastInpainter(int method = cv::INPAINT_TELEA);
+		virtual ~FastInpainter();
+
+		virtual void Init(InpaintingParams& parameters) override;
+		virtual void Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted) override;
+
+		// inpaints the pixels of image where fillMask != 0, only the region around them is processed
+		static void FillHoles(cv::Mat& image, const cv::Mat1b& fillMask, int radius, int method);
+
+	protected:
+		InpaintingParams params;
+		int method;
+		cv::Mat1b fillMask;
+	};
+}
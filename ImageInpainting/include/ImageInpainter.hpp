@@ -1,27 +1,42 @@
 #pragma once
 
 #include "..\src\InpaintingLevel.hpp"
+#include "InpaintingEngine.hpp"
 #include <vector>
 
 namespace inpainting 
 {
-	class ImageInpainter
+	class ImageInpainter : public InpaintingEngine
 	{
 	public:
 		ImageInpainter();
-		~ImageInpainter();
+		virtual ~ImageInpainter();
 
-		virtual void Init(InpaintingParams& parameters);
-		virtual void Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted);
+		virtual void Init(InpaintingParams& parameters) override;
+		virtual void Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted) override;
 
 	protected:
 		InpaintingParams params;
 		std::vector<InpaintingLevel> levels;
-		cv::Mat3b mColor;
-		cv::Mat1b mAlpha;
+		cv::Mat1b mAlpha;	// blurred mask for the final composite
+		cv::Mat1i ccLabels;	// connected components of the holes, see LabelHoles
+		std::vector<int> ccParent;
+		std::vector<cv::Rect> ccBoxes;
+		cv::Mat1i mBlurSums;	// row sums of BlurMask
+		std::vector<int> mBlurColumns;
+		cv::Mat3b mTileOut;	// composite of the current tile
+		cv::Mat1b mTileMask;	// mask of the region, tiles that are done count as known
 		virtual void Initialize(cv::InputArray color, cv::InputArray mask);
-		int CalcNumberOfLevels(cv::InputArray color);
+		int CalcNumberOfLevels(cv::InputArray color, int holeExtent);
+		int CalcMaxHoleExtent(const cv::Mat1b& mask);
+		int LabelHoles(const cv::Mat1b& mask);
+		void BlurMask(const cv::Mat1b& mask);
+		InpaintingParams LevelParams(size_t level) const;
+		cv::Rect CalcHoleRect(const cv::Mat1b& mask);
+		cv::Rect CalcRoi(const cv::Rect& holes, const cv::Size& frameSize, int margin);
+		std::vector<cv::Rect> CalcTiles(const cv::Rect& roi);
+		void RunLevels(int numLevels);
 		void FillInLowerLv(InpaintingLevel& pmUpper, InpaintingLevel& pmLower);
-		void BlendBorder(cv::OutputArray dst);
+		void BlendBorder(cv::OutputArray dst);	// dst has to hold the source frame
 	};
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "..\src\InpaintingLevel.hpp"
+#include <memory>
+#include <string>
+
+namespace inpainting
+{
+	// Available inpainting methods, ordered by how their work per frame scales (the measured times
+	// come from the engine benchmark of InpaintingTests):
+	// PatchMatch		patch based synthesis on an image pyramid with temporal coherence (VideoInpainter),
+	//					work grows with hole pixels * iterations * candidates per pixel
+	// Telea			fast marching (cv::inpaint) around the holes, work grows with hole pixels * radius^2,
+	//					no texture and no temporal state
+	// NavierStokes		diffusion (cv::inpaint), same order of work as Telea
+	// TemporalCopy		last color seen at the same pixel, one pass over the frame (fixed cameras only)
+	enum class EngineType
+	{
+		PatchMatch,
+		Telea,
+		NavierStokes,
+		TemporalCopy
+	};
+
+	class InpaintingEngine
+	{
+	public:
+		virtual ~InpaintingEngine() { }
+
+		virtual void Init(InpaintingParams& parameters) = 0;
+		// mask: 0 marks the pixels to inpaint
+		virtual void Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted) = 0;
+	};
+
+	std::unique_ptr<InpaintingEngine> CreateEngine(EngineType type);
+	// accepts "patchmatch", "telea", "ns" and "temporal", returns false for anything else
+	bool ParseEngineType(const std::string& name, EngineType& type);
+}
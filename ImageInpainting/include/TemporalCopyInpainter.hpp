@@ -0,0 +1,24 @@
+#pragma once
+
+#include "InpaintingEngine.hpp"
+
+namespace inpainting
+{
+	// Fills every hole pixel with the last color seen at that pixel while it wasn't masked, which
+	// only makes sense for a fixed camera. Pixels that were never visible fall back to Telea.
+	class TemporalCopyInpainter : public InpaintingEngine
+	{
+	public:
+		TemporalCopyInpainter();
+		virtual ~TemporalCopyInpainter();
+
+		virtual void Init(InpaintingParams& parameters) override;
+		virtual void Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted) override;
+
+	protected:
+		InpaintingParams params;
+		cv::Mat3b plate;		// last visible color per pixel
+		cv::Mat1b seen;			// != 0 if plate holds a color
+		cv::Mat1b unseenMask;	// holes without a color in plate
+	};
+}
@@ -2,24 +2,70 @@
 
 #include "..\src\InpaintingLevel.hpp"
 #include "ImageInpainter.hpp"
+#include <memory>
 #include <vector>
 
 namespace inpainting
 {
-	class VideoInpainter : ImageInpainter
+	class VideoInpainter : public ImageInpainter
 	{
 	public:
 		VideoInpainter();
-		~VideoInpainter();
+		virtual ~VideoInpainter();
 
 		virtual void Init(InpaintingParams& parameters) override;
 		virtual void Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted) override;
 
 	protected:
-		cv::Size initializedSize;
+		// a group of holes that is inpainted on its own, followed across frames by overlap
+		struct ComponentTrack
+		{
+			cv::Rect holes;
+			std::unique_ptr<VideoInpainter> inpainter;
+			cv::Mat1b mask;		// only the holes of this group
+			cv::Mat1b exclude;	// holes of the other groups inside the region
+			bool hasExclude;
+		};
+
+		cv::Rect initializedRoi;
+		size_t numActiveLevels;	// pyramid depth of the current frame, all levels up to the maximum stay allocated
 		cv::Mat3b mColorLast;
 		cv::Mat1b mAlphaLast;
+		std::vector<cv::Mat4b> lvColors;	// per level scratch for building the pyramid
+		std::vector<cv::Mat1b> lvMasks;
+		std::vector<cv::Mat1b> lvExcludes;
+		cv::Mat1f thumb, prevThumb, thumbWindow;	// motion estimation between consecutive frames
+		int thumbScale;
+		bool hasPrevThumb;
+		cv::Point2d motionRemainder;	// sub-pixel motion (x, y) that wasn't applied yet
+		std::vector<ComponentTrack> tracks, prevTracks;
+		std::vector<int> groupOf, trackLabels;	// group of every hole label, hole label of every track
+		std::vector<cv::Rect> groupHoles;
+		cv::Mat3b cachedColor;	// input of the last full run, for the result cache
+		cv::Mat1b cachedMask;
+		cv::Mat1b cachedExclude;
+		bool hasCachedResult;
+		cv::Mat3b plate, plateTmp;	// last color seen at every pixel, moved with the camera
+		cv::Mat1b plateAge, plateAgeTmp;	// frames since the pixel was seen, 255 for never
+		cv::Mat3b plateColor;	// frame with the recently seen holes filled from the plate
+		cv::Mat1b plateMask;	// mask without them
+		bool hasPlate;
+		static const int plateBlockSize = 16;
+		int plateBlocksX;
+		std::vector<int> plateBlockSad, plateBlockCount;	// plate against the known pixels per block
+		std::vector<uchar> plateBlockTrusted;	// != 0 if the block's holes may be filled from the plate
 		virtual void Initialize(cv::InputArray color, cv::InputArray mask) override;
-		void LoadFrame(cv::InputArray color, cv::InputArray mask);
+		// exclude != 0 marks holes that are filled elsewhere, they are known but no source and not observed
+		void LoadFrame(cv::InputArray color, cv::InputArray mask, const cv::Mat1b& exclude);
+		void InpaintRoi(const cv::Mat& colorRoi, const cv::Mat& maskRoi, const cv::Rect& roi, cv::Mat& dst, const cv::Mat1b& exclude = cv::Mat1b());
+		bool IsCachedResult(const cv::Mat& colorRoi, const cv::Mat& maskRoi, const cv::Mat1b& exclude);
+		void InpaintComponents(const cv::Mat& color, const cv::Mat& mask, cv::Mat& inpainted);
+		class TracksBody;
+		void InpaintTrack(int t, const cv::Mat& color, const cv::Mat& mask, cv::Mat& inpainted);
+		bool EstimateMotion(const cv::Mat& color, cv::Vec2i& motion);
+		void UpdatePlate(const cv::Mat& color, const cv::Mat& mask, const cv::Mat1b& exclude, const cv::Vec2i& motion, bool continuous);
+		void CheckPlate(const cv::Mat& color, const cv::Mat& mask, const cv::Mat1b& exclude, int maxAge);
+		void AgePlate(const cv::Mat& mask, const cv::Mat1b& exclude);
+		cv::Rect SelectRoi(const cv::Rect& holes, const cv::Size& frameSize);
 	};
-}
\ No newline at end of file
+}
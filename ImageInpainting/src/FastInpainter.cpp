@@ -0,0 +1,38 @@
+#include "..\include\FastInpainter.hpp"
+
+namespace inpainting {
+
+	FastInpainter::FastInpainter(int method) : method(method) { }
+	FastInpainter::~FastInpainter() { }
+
+	void FastInpainter::Init(InpaintingParams& parameters) {
+		params = parameters;
+	}
+
+	void FastInpainter::Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted)
+	{
+		assert(color.size() == mask.size());
+		assert(color.type() == CV_8UC3);
+		assert(mask.type() == CV_8U);
+
+		color.copyTo(inpainted);
+		fillMask = mask.getMat() == 0;
+		cv::Mat out = inpainted.getMat();
+		FillHoles(out, fillMask, params.fastInpaintRadius, method);
+	}
+
+	void FastInpainter::FillHoles(cv::Mat & image, const cv::Mat1b & fillMask, int radius, int method)
+	{
+		const cv::Rect holes = cv::boundingRect(fillMask);
+		if (holes.empty()) return;
+
+		// cv::inpaint only looks radius pixels around the holes
+		const int margin = radius + 1;
+		const cv::Rect roi = cv::Rect(holes.x - margin, holes.y - margin, holes.width + 2 * margin, holes.height + 2 * margin)
+			& cv::Rect(cv::Point(0, 0), image.size());
+		cv::Mat region = image(roi);
+		cv::Mat filled;
+		cv::inpaint(region, fillMask(roi), filled, radius, method);
+		filled.copyTo(region);
+	}
+}
@@ -1,7 +1,91 @@
 #include "..\include\ImageInpainter.hpp"
+#include "Pyramid.hpp"
+#include <climits>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INPAINTING_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace inpainting {
 
+#ifdef INPAINTING_SSE2
+	// Blends 4 pixels of the band as the scalar path does: x = a*dst + (255-a)*pm + 128 in 16 bit
+	// lanes, divided by 255 as mulhi(x, 257), which equals (a*dst + (255-a)*pm + 127) / 255 for all
+	// 8 bit inputs. Pixels with alpha 255 are neither read nor written, they may belong to a
+	// neighbouring group that is blended concurrently.
+	static inline void BlendPixels4(const uchar* alpha, const uchar* pm, uchar* dst)
+	{
+		int alpha4;
+		std::memcpy(&alpha4, alpha, sizeof(alpha4));
+		__m128i a = _mm_cvtsi32_si128(alpha4);
+		a = _mm_unpacklo_epi8(a, a);
+		a = _mm_unpacklo_epi16(a, a);	// the alpha of each pixel in all four of its bytes
+
+		// dst is BGR, spread to BGRx so it lines up with pm
+		uchar pixels[16] = { 0 };
+		for (int i = 0; i < 4; ++i) if (alpha[i] != 255) std::memcpy(pixels + 4 * i, dst + 3 * i, 3);
+		const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+		const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pm));
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i max = _mm_set1_epi16(255);
+		const __m128i half = _mm_set1_epi16(128);
+		const __m128i div255 = _mm_set1_epi16(257);
+		const __m128i aLo = _mm_unpacklo_epi8(a, zero);
+		const __m128i aHi = _mm_unpackhi_epi8(a, zero);
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(aLo, _mm_unpacklo_epi8(d, zero)), _mm_mullo_epi16(_mm_sub_epi16(max, aLo), _mm_unpacklo_epi8(p, zero)));
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(aHi, _mm_unpackhi_epi8(d, zero)), _mm_mullo_epi16(_mm_sub_epi16(max, aHi), _mm_unpackhi_epi8(p, zero)));
+		lo = _mm_mulhi_epu16(_mm_add_epi16(lo, half), div255);
+		hi = _mm_mulhi_epu16(_mm_add_epi16(hi, half), div255);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), _mm_packus_epi16(lo, hi));
+
+		for (int i = 0; i < 4; ++i) if (alpha[i] != 255) std::memcpy(dst + 3 * i, pixels + 4 * i, 3);
+	}
+#endif
+
+	// Alpha 255 keeps dst untouched, 0 copies the PatchMatch color and only the band in between is
+	// blended (8 bit fixed point). Runs of 16 pixels that are completely known or completely inside a hole
+	// are recognized at once, which is almost the whole row, the band is blended 4 pixels at a time.
+	// pm is BGRx, dst is BGR.
+	static void BlendRow(const uchar* alpha, const uchar* pm, uchar* dst, int width)
+	{
+		int c = 0;
+		while (c < width)
+		{
+#ifdef INPAINTING_SSE2
+			if (c + 16 <= width)
+			{
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + c));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_set1_epi8(char(255)))) == 0xFFFF)
+				{
+					c += 16;
+					continue;
+				}
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, _mm_setzero_si128())) == 0xFFFF)
+				{
+					for (int i = c; i < c + 16; ++i) std::memcpy(dst + 3 * i, pm + 4 * i, 3);
+					c += 16;
+					continue;
+				}
+				for (const int end = c + 16; c < end; c += 4) BlendPixels4(alpha + c, pm + 4 * c, dst + 3 * c);
+				continue;
+			}
+#endif
+			const int end = std::min(c + 16, width);
+			for (; c < end; ++c)
+			{
+				const int a = alpha[c];
+				if (a == 255) continue;
+				for (int k = 0; k < 3; ++k)
+				{
+					dst[3 * c + k] = uchar((a * dst[3 * c + k] + (255 - a) * pm[4 * c + k] + 127) / 255);
+				}
+			}
+		}
+	}
+
 	ImageInpainter::ImageInpainter() { }
 	ImageInpainter::~ImageInpainter() { }
 
@@ -15,119 +99,332 @@ namespace inpainting {
 		assert(color.type() == CV_8UC3);
 		assert(mask.type() == CV_8U);
 
-		Initialize(color, mask);
+		// everything outside the region around the holes passes through untouched
+		color.copyTo(inpainted);
+		const cv::Rect holes = CalcHoleRect(mask.getMat());
+		if (holes.empty()) return;
+		const cv::Rect roi = CalcRoi(holes, color.size(), params.contextMargin);
 
-		for (int i = int(levels.size()) - 1; i >= 0; --i)
+		const std::vector<cv::Rect> tiles = CalcTiles(roi);
+		if (tiles.size() == 1)
 		{
-			levels[i].Run();
-			if (i > 0) FillInLowerLv(levels[i], levels[i - 1]);
+			Initialize(color.getMat()(roi), mask.getMat()(roi));
+
+			RunLevels(int(levels.size()));
+
+			cv::Mat dst = inpainted.getMat()(roi);
+			BlendBorder(dst);
+			return;
 		}
 
-		BlendBorder(inpainted);
+		// Every tile is inpainted with tileHalo pixels of context around it, but only the tile itself
+		// is written, so each hole pixel is filled exactly once. Peak memory follows the tile size.
+		// Tiles that are done count as known for the following ones, so a tile deep inside a large
+		// hole still finds sources next to its predecessors. If its context holds fewer known pixels
+		// than the tile has holes, the halo is doubled up to 4 * tileHalo (such tiles exceed the
+		// budget), beyond that the tile is filled from the known pixels the region has.
+		cv::Mat out = inpainted.getMat();
+		mask.getMat()(roi).copyTo(mTileMask);
+		const int maxHalo = std::max(4 * params.tileHalo, 16);
+		for (const auto& tile : tiles)
+		{
+			const cv::Rect local = tile - roi.tl();
+			if (CalcHoleRect(mTileMask(local)).empty()) continue;
+			const int tileHoles = local.area() - cv::countNonZero(mTileMask(local));
+			int halo = params.tileHalo;
+			cv::Rect region;
+			while (true)
+			{
+				region = cv::Rect(tile.x - halo, tile.y - halo, tile.width + 2 * halo, tile.height + 2 * halo) & roi;
+				if (region == roi || halo >= maxHalo || cv::countNonZero(mTileMask(region - roi.tl())) >= tileHoles) break;
+				halo = std::min(std::max(2 * halo, 16), maxHalo);
+			}
+
+			Initialize(out(region), mTileMask(region - roi.tl()));
+
+			RunLevels(int(levels.size()));
+
+			out(region).copyTo(mTileOut);
+			BlendBorder(mTileOut);
+			mTileOut(tile - region.tl()).copyTo(out(tile));
+			mTileMask(local).setTo(255);
+		}
 	}
 
 	void ImageInpainter::Initialize(cv::InputArray color, cv::InputArray mask)
 	{
 		// build pyramid
-		levels.resize(CalcNumberOfLevels(color));
-		levels[0].Init(color.size(), params);
+		levels.resize(CalcNumberOfLevels(color, CalcMaxHoleExtent(mask.getMat())));
+		levels[0].Init(color.size(), LevelParams(0));
 		levels[0].LoadFrame(color.getMat(), mask.getMat());
 
 		for (int i = 1; i < levels.size(); ++i)
 		{
-			auto lvSize = levels[i - 1].GetColorPtr()->size() / 2;
-
-			// color
-			cv::Mat3b tmpColor;
-			cv::resize(*(levels[i - 1].GetColorPtr()), tmpColor, lvSize, 0.0, 0.0, cv::INTER_LINEAR);
-			// mask
+			// color and mask in one pass, the mask is min-pooled so it stays binary
+			cv::Mat4b tmpColor;
 			cv::Mat1b tmpMask;
-			cv::resize(*(levels[i - 1].GetMaskPtr()), tmpMask, lvSize, 0.0, 0.0, cv::INTER_LINEAR);
-			for (int r = 0; r < tmpMask.rows; ++r)
-			{
-				auto ptrMask = tmpMask.ptr<uchar>(r);
-				for (int c = 0; c < tmpMask.cols; ++c)
-				{
-					ptrMask[c] = ptrMask[c] < 255 ? 0 : 255;
-				}
-			}
+			PyrDown2x(*(levels[i - 1].GetColorPtr()), *(levels[i - 1].GetMaskPtr()), tmpColor, tmpMask);
 
-			levels[i].Init(color.size(), params);
+			levels[i].Init(tmpColor.size(), LevelParams(i));
 			levels[i].LoadFrame(tmpColor, tmpMask);
 		}
 		// for the final composite
-		mColor = color.getMat().clone();
-		cv::blur(mask, mAlpha, cv::Size(params.blurSize, params.blurSize));
+		BlurMask(mask.getMat());
 	}
 
-	int ImageInpainter::CalcNumberOfLevels(cv::InputArray color)
+	int ImageInpainter::CalcNumberOfLevels(cv::InputArray color, int holeExtent)
 	{
+		// a hole is filled from coarse to fine until it is about one patch wide, further levels would
+		// be wasted on small holes. holeExtent < 0 only considers the frame size.
+		const int patchSize = 5;
 		auto numLevels = 1;
 		auto size = std::min(color.cols(), color.rows());
-		while (size >= 5) {
+		while (size >= 5 && (holeExtent < 0 || holeExtent > patchSize)) {
 			size /= 2;
+			if (holeExtent > 0) holeExtent = (holeExtent + 1) / 2;
 			numLevels++;
 			if (numLevels >= params.maxLevels) break;
 		}
 
 		return numLevels;
 	}
-	void ImageInpainter::FillInLowerLv(InpaintingLevel & levelUpper, InpaintingLevel & levelLower)
+
+	int ImageInpainter::CalcMaxHoleExtent(const cv::Mat1b & mask)
 	{
-		cv::Mat3b mColorUpsampled;
-		cv::resize(*(levelUpper.GetColorPtr()), mColorUpsampled, levelLower.GetColorPtr()->size(), 0.0, 0.0, cv::INTER_LINEAR);
-		cv::Mat2i mPosMapUpsampled;
-		cv::resize(*(levelUpper.GetPosMapPtr()), mPosMapUpsampled, levelLower.GetPosMapPtr()->size(), 0.0, 0.0, cv::INTER_NEAREST);
-		for (int r = 0; r < mPosMapUpsampled.rows; ++r)
+		// largest width or height of a single hole, separate holes don't add up
+		const int numLabels = LabelHoles(mask);
+
+		int extent = 0;
+		for (int i = 1; i < numLabels; ++i)
 		{
-			auto ptr = mPosMapUpsampled.ptr<cv::Vec2i>(r);
-			for (int c = 0; c < mPosMapUpsampled.cols; ++c) ptr[c] = ptr[c] * 2 + cv::Vec2i(r % 2, c % 2);
+			extent = std::max(extent, std::max(ccBoxes[i].width, ccBoxes[i].height));
 		}
+		return extent;
+	}
 
-		auto mColorLw = *(levelLower.GetColorPtr());
-		auto mMaskLw = *(levelLower.GetMaskPtr());
-		auto mPosMapLw = *(levelLower.GetPosMapPtr());
+	// Labels the 8-connected holes like cv::connectedComponentsWithStats: ccLabels holds 1 to n - 1
+	// for the holes and 0 for known pixels, ccBoxes[i] the bounding box of hole i, n is returned.
+	// Two passes with union-find over member buffers, which only grow with the region, where
+	// OpenCV would set up its tables on every call.
+	int ImageInpainter::LabelHoles(const cv::Mat1b & mask)
+	{
+		ccLabels.create(mask.size());
+		// a new provisional label has no labeled pixel among its 8 neighbours, so at most every
+		// other pixel of every other row starts one
+		ccParent.resize(((mask.rows + 1) / 2) * ((mask.cols + 1) / 2) + 1);
+		auto find = [this](int label) {
+			while (ccParent[label] != label) label = ccParent[label] = ccParent[ccParent[label]];
+			return label;
+		};
+		// the root of a set is its smallest label
+		auto unite = [&](int a, int b) {
+			a = find(a);
+			b = find(b);
+			if (a < b) ccParent[b] = a;
+			else ccParent[a] = b;
+			return std::min(a, b);
+		};
 
-		const int wLw = levelLower.GetColorPtr()->cols;
-		const int hLw = levelLower.GetColorPtr()->rows;
-		for (int r = 0; r < hLw; ++r)
+		int numProvisional = 1;
+		for (int r = 0; r < mask.rows; ++r)
 		{
-			auto ptrColorLw = mColorLw.ptr<cv::Vec3b>(r);
-			auto ptrColorUpsampled = mColorUpsampled.ptr<cv::Vec3b>(r);
-			auto ptrMaskLw = mMaskLw.ptr<uchar>(r);
-			auto ptrPosMapLw = mPosMapLw.ptr<cv::Vec2i>(r);
-			auto ptrPosMapUpsampled = mPosMapUpsampled.ptr<cv::Vec2i>(r);
-			for (int c = 0; c < wLw; ++c)
+			auto ptrMask = mask.ptr<uchar>(r);
+			auto ptrLabel = ccLabels.ptr<int>(r);
+			auto ptrAbove = r > 0 ? ccLabels.ptr<int>(r - 1) : nullptr;
+			for (int c = 0; c < mask.cols; ++c)
 			{
-				if (ptrMaskLw[c] == 0)
+				int label = 0;
+				if (ptrMask[c] == 0)
 				{
-					ptrColorLw[c] = ptrColorUpsampled[c];
-					ptrPosMapLw[c] = ptrPosMapUpsampled[c];
+					if (c > 0 && ptrLabel[c - 1] != 0) label = ptrLabel[c - 1];
+					for (int k = std::max(c - 1, 0); ptrAbove && k <= std::min(c + 1, mask.cols - 1); ++k)
+					{
+						if (ptrAbove[k] != 0) label = label == 0 ? ptrAbove[k] : unite(label, ptrAbove[k]);
+					}
+					if (label == 0)
+					{
+						label = numProvisional++;
+						ccParent[label] = label;
+					}
 				}
+				ptrLabel[c] = label;
 			}
 		}
+
+		// every label points to a smaller one of its set or to itself, so in increasing order the
+		// final labels are consecutive
+		int numLabels = 1;
+		ccParent[0] = 0;
+		for (int label = 1; label < numProvisional; ++label)
+		{
+			ccParent[label] = ccParent[label] < label ? ccParent[ccParent[label]] : numLabels++;
+		}
+
+		// the boxes hold the last row and column until all pixels are seen
+		ccBoxes.assign(numLabels, cv::Rect(INT_MAX, INT_MAX, -1, -1));
+		for (int r = 0; r < mask.rows; ++r)
+		{
+			auto ptrLabel = ccLabels.ptr<int>(r);
+			for (int c = 0; c < mask.cols; ++c)
+			{
+				if (ptrLabel[c] == 0) continue;
+				ptrLabel[c] = ccParent[ptrLabel[c]];
+				cv::Rect& box = ccBoxes[ptrLabel[c]];
+				box.x = std::min(box.x, c);
+				box.y = std::min(box.y, r);
+				box.width = std::max(box.width, c);
+				box.height = std::max(box.height, r);
+			}
+		}
+		for (int i = 1; i < numLabels; ++i)
+		{
+			ccBoxes[i].width -= ccBoxes[i].x - 1;
+			ccBoxes[i].height -= ccBoxes[i].y - 1;
+		}
+		return numLabels;
 	}
-	void ImageInpainter::BlendBorder(cv::OutputArray dst)
+
+	static int Reflect101(int p, int n)
 	{
-		cv::Mat3f mColorF, mPMColorF, mDstF(levels[0].GetColorPtr()->size());
-		mColor.convertTo(mColorF, CV_32FC3, 1.0 / 255.0);
-		levels[0].GetColorPtr()->convertTo(mPMColorF, CV_32FC3, 1.0 / 255.0);
+		if (n == 1) return 0;
+		while (p < 0 || p >= n) p = p < 0 ? -p : 2 * (n - 1) - p;
+		return p;
+	}
+
+	// Mean over a blurSize box with the default border of cv::blur (reflected without repeating the
+	// edge), rounded to nearest. Running sums in member buffers, where cv::blur would set up its
+	// filter engine on every call.
+	void ImageInpainter::BlurMask(const cv::Mat1b & mask)
+	{
+		const int ksize = std::max(params.blurSize, 1);
+		const int anchor = ksize / 2;
+		const int area = ksize * ksize;
+		mAlpha.create(mask.size());
+		mBlurSums.create(mask.size());
+		mBlurColumns.resize(mask.cols);
+
+		for (int r = 0; r < mask.rows; ++r)
+		{
+			auto ptrMask = mask.ptr<uchar>(r);
+			auto ptrSums = mBlurSums.ptr<int>(r);
+			int sum = 0;
+			for (int k = -anchor; k < ksize - anchor; ++k) sum += ptrMask[Reflect101(k, mask.cols)];
+			for (int c = 0; c < mask.cols; ++c)
+			{
+				ptrSums[c] = sum;
+				sum += ptrMask[Reflect101(c + ksize - anchor, mask.cols)] - ptrMask[Reflect101(c - anchor, mask.cols)];
+			}
+		}
+
+		std::fill(mBlurColumns.begin(), mBlurColumns.end(), 0);
+		for (int k = -anchor; k < ksize - anchor; ++k)
+		{
+			auto ptrSums = mBlurSums.ptr<int>(Reflect101(k, mask.rows));
+			for (int c = 0; c < mask.cols; ++c) mBlurColumns[c] += ptrSums[c];
+		}
+		for (int r = 0; r < mask.rows; ++r)
+		{
+			auto ptrAlpha = mAlpha.ptr<uchar>(r);
+			auto ptrAdd = mBlurSums.ptr<int>(Reflect101(r + ksize - anchor, mask.rows));
+			auto ptrSub = mBlurSums.ptr<int>(Reflect101(r - anchor, mask.rows));
+			for (int c = 0; c < mask.cols; ++c)
+			{
+				ptrAlpha[c] = uchar((mBlurColumns[c] + area / 2) / area);
+				mBlurColumns[c] += ptrAdd[c] - ptrSub[c];
+			}
+		}
+	}
 
-		cv::Mat1f mAlphaF;
-		mAlpha.convertTo(mAlphaF, CV_32F, 1.0 / 255.0);
+	InpaintingParams ImageInpainter::LevelParams(size_t level) const
+	{
+		// coarse levels are cheap, so they can get more iterations than the finest one
+		InpaintingParams levelParams = params;
+		const int maxItr = level == 0 ? params.maxItrFine : params.maxItrCoarse;
+		if (maxItr >= 0) levelParams.maxItr = maxItr;
+		return levelParams;
+	}
 
-		for (int r = 0; r < mColor.rows; ++r)
+	cv::Rect ImageInpainter::CalcHoleRect(const cv::Mat1b & mask)
+	{
+		int top = mask.rows, bottom = -1, left = mask.cols, right = -1;
+		for (int r = 0; r < mask.rows; ++r)
 		{
-			auto ptrSrc = mColorF.ptr<cv::Vec3f>(r);
-			auto ptrPM = mPMColorF.ptr<cv::Vec3f>(r);
-			auto ptrDst = mDstF.ptr<cv::Vec3f>(r);
-			auto ptrAlpha = mAlphaF.ptr<float>(r);
-			for (int c = 0; c < mColor.cols; ++c)
+			auto ptrMask = mask.ptr<uchar>(r);
+			for (int c = 0; c < mask.cols; ++c)
 			{
-				ptrDst[c] = ptrAlpha[c] * ptrSrc[c] + (1.0f - ptrAlpha[c]) * ptrPM[c];
+				if (ptrMask[c] != 0) continue;
+				top = std::min(top, r);
+				bottom = r;
+				left = std::min(left, c);
+				right = std::max(right, c);
 			}
 		}
 
-		mDstF.convertTo(dst, CV_8UC3, 255.0);
+		if (bottom < 0) return cv::Rect();
+		return cv::Rect(left, top, right - left + 1, bottom - top + 1);
+	}
+
+	cv::Rect ImageInpainter::CalcRoi(const cv::Rect & holes, const cv::Size & frameSize, int margin)
+	{
+		const cv::Rect frame(cv::Point(0, 0), frameSize);
+		if (margin < 0) return frame;
+
+		// the final composite blurs the mask, the context has to cover that at least
+		margin = std::max(margin, params.blurSize);
+		return cv::Rect(holes.x - margin, holes.y - margin, holes.width + 2 * margin, holes.height + 2 * margin) & frame;
+	}
+
+	std::vector<cv::Rect> ImageInpainter::CalcTiles(const cv::Rect & roi)
+	{
+		// pyramid (4/3 of the finest level), blurred mask, hole components and the tile composite
+		const size_t bytesPerPixel = InpaintingLevel::BytesPerPixel(params.costMode) * 4 / 3 + 2 * sizeof(uchar) + sizeof(int) + sizeof(cv::Vec3b);
+		if (params.tileMemoryBudget == 0 || size_t(roi.area()) * bytesPerPixel <= params.tileMemoryBudget) return { roi };
+
+		// largest square tile that fits into the budget together with its halo, tiny budgets are exceeded
+		const int side = int(std::sqrt(double(params.tileMemoryBudget) / double(bytesPerPixel)));
+		const int tileSize = std::max(side - 2 * params.tileHalo, 32);
+
+		std::vector<cv::Rect> tiles;
+		for (int y = roi.y; y < roi.y + roi.height; y += tileSize)
+		{
+			for (int x = roi.x; x < roi.x + roi.width; x += tileSize)
+			{
+				tiles.push_back(cv::Rect(x, y, tileSize, tileSize) & roi);
+			}
+		}
+		return tiles;
+	}
+
+	void ImageInpainter::RunLevels(int numLevels)
+	{
+		// below finestOptimizedLevel the upsampled matches of the coarser level are only gathered,
+		// at least the coarsest level is always optimized
+		const int finestOptimized = std::min(std::max(params.finestOptimizedLevel, 0), numLevels - 1);
+		for (int i = numLevels - 1; i >= 0; --i)
+		{
+			if (i >= finestOptimized) levels[i].Run();
+			else levels[i].Gather();
+			if (i > 0) FillInLowerLv(levels[i], levels[i - 1]);
+		}
+	}
+
+	void ImageInpainter::FillInLowerLv(InpaintingLevel & levelUpper, InpaintingLevel & levelLower)
+	{
+		// only the holes of the lower level are written
+		levelLower.UpsampleFrom(levelUpper);
+	}
+
+	void ImageInpainter::BlendBorder(cv::OutputArray dst)
+	{
+		// dst holds the source frame already, the PatchMatch result only goes where the blurred mask is below 255
+		cv::Mat dstMat = dst.getMat();
+		const cv::Mat4b& pmColor = *(levels[0].GetColorPtr());
+		assert(dstMat.size() == pmColor.size() && dstMat.type() == CV_8UC3);
+
+#pragma omp parallel for schedule(static)
+		for (int r = 0; r < mAlpha.rows; ++r)
+		{
+			BlendRow(mAlpha.ptr<uchar>(r), pmColor.ptr<uchar>(r), dstMat.ptr<uchar>(r), mAlpha.cols);
+		}
 	}
 }
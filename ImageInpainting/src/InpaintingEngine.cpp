@@ -0,0 +1,28 @@
+#include "..\include\InpaintingEngine.hpp"
+#include "..\include\VideoInpainter.hpp"
+#include "..\include\FastInpainter.hpp"
+#include "..\include\TemporalCopyInpainter.hpp"
+
+namespace inpainting {
+
+	std::unique_ptr<InpaintingEngine> CreateEngine(EngineType type)
+	{
+		switch (type)
+		{
+		case EngineType::Telea: return std::unique_ptr<InpaintingEngine>(new FastInpainter(cv::INPAINT_TELEA));
+		case EngineType::NavierStokes: return std::unique_ptr<InpaintingEngine>(new FastInpainter(cv::INPAINT_NS));
+		case EngineType::TemporalCopy: return std::unique_ptr<InpaintingEngine>(new TemporalCopyInpainter());
+		default: return std::unique_ptr<InpaintingEngine>(new VideoInpainter());
+		}
+	}
+
+	bool ParseEngineType(const std::string& name, EngineType& type)
+	{
+		if (name == "patchmatch") type = EngineType::PatchMatch;
+		else if (name == "telea") type = EngineType::Telea;
+		else if (name == "ns") type = EngineType::NavierStokes;
+		else if (name == "temporal") type = EngineType::TemporalCopy;
+		else return false;
+		return true;
+	}
+}
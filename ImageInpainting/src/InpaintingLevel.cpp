@@ -1,18 +1,59 @@
 #pragma once
 
 #include "InpaintingLevel.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
 
 namespace inpainting
 {
+	// 8-neighbourhood used by the spatial cost
+	static const int sptAdjR[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+	static const int sptAdjC[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+
+	static CostWeight ToCostWeight(const float w)
+	{
+		if (w == 0.0f) return CostWeight::Zero;
+		if (w == 1.0f) return CostWeight::One;
+		return CostWeight::Any;
+	}
+
+	template<CostWeight W>
+	static inline float WeightValue(const float w)
+	{
+		return W == CostWeight::Zero ? 0.0f : W == CostWeight::One ? 1.0f : w;
+	}
+
+	// FLT_MAX marks a pixel without a usable match (invalid upsampled source, rejected evaluation)
+	static inline bool IsUsableCost(const float cost)
+	{
+		return std::isfinite(cost) && cost < FLT_MAX;
+	}
+
+	// Cost sums are accumulated in fixed point with 2^-24 steps: integer addition gives the same
+	// total in whatever order the threads add their parts, so the convergence test of a fixed seed
+	// doesn't depend on the scheduling. A single cost is capped far above any usable match.
+	static const double fixedCostScale = double(1 << 24);
+	static inline long long ToFixedCost(const double cost)
+	{
+		return std::llround(std::min(cost, 1.0e4) * fixedCostScale);
+	}
+
+	// Replacing a sentinel counts as a change but not as an improvement, a single one would
+	// otherwise outweigh the decrease of all other pixels.
+	static inline void CountUpdate(const float before, const float after, int& changed, long long& improvement)
+	{
+		if (!(after < before)) return;
+		changed++;
+		if (IsUsableCost(before)) improvement += ToFixedCost(double(before) - double(after));
+	}
+
 	InpaintingLevel::InpaintingLevel()
 		: borderSize(2), borderSizePosMap(1), windowSize(5), toLeft(0, -1), toRight(0, 1), toUp(-1, 0), toDown(1, 0) 
 	{
-		vSptAdj =
-		{
-			cv::Vec2i(-1, -1),	cv::Vec2i(-1, 0),	cv::Vec2i(-1, 1),
-			cv::Vec2i(0, -1),						cv::Vec2i(0, 1),
-			cv::Vec2i(1, -1),	cv::Vec2i(1, 0),	cv::Vec2i(1, 1)
-		};
+		patchSsd = GetPatchSsd5x5();
+		lumaSsd = GetPatchSsd5x5Luma();
 	}
 
 	InpaintingLevel::~InpaintingLevel() { }
@@ -22,57 +63,275 @@ namespace inpainting
 		firstFrame = true;
 		size = initSize;
 		params = parameters;
-		std::random_device rnd;
-		mt = std::mt19937(rnd());
-		cRand = std::uniform_int_distribution<int>(0, size.width - 1);
-		rRand = std::uniform_int_distribution<int>(0, size.height - 1);
+		const unsigned int seed = params.seed != 0 ? params.seed : std::random_device()();
+		mt = std::mt19937(seed);
+		levelSeed = seed ^ (static_cast<unsigned int>(size.width) << 16 | static_cast<unsigned int>(size.height));
+		passCount = 0;
+		searchRadius = params.randSearchRadius >= 0.0f ? int(params.randSearchRadius * std::max(size.width, size.height)) : 0;
+		assert(size.width <= SHRT_MAX && size.height <= SHRT_MAX);
+
+		// all buffers are allocated here, so loading and running a frame of this size doesn't allocate
+		const cv::Size borderedSize(size.width + 2 * borderSize, size.height + 2 * borderSize);
+		const cv::Size borderedSizePosMap(size.width + 2 * borderSizePosMap, size.height + 2 * borderSizePosMap);
+		AllocColorMat(mColor, borderedSize, borderSize);
+		AllocColorMat(prevColor, borderedSize, borderSize);
+		AllocBorderMat(mMask, borderedSize, borderSize);
+		AllocBorderMat(prevMask, borderedSize, borderSize);
+		AllocBorderMat(mSources, borderedSize, borderSize);
+		AllocBorderMat(mPosMap, borderedSizePosMap, borderSizePosMap);
+		mCostMap.create(size);
+		if (params.costMode != CostMode::Rgb)
+		{
+			AllocBorderMat(mLuma, borderedSize, borderSize);
+			AllocBorderMat(prevLuma, borderedSize, borderSize);
+		}
+		if (params.costMode == CostMode::LumaChromaRefine) mRefineCostMap.create(size);
+		mPatchValidTmp.create(borderedSize.height, size.width);
+		mPatchValidBuf.create(size);
+		shiftColorTmp.create(size);
+		shiftMaskTmp.create(size);
+		shiftPosMapTmp.create(size);
+		mChanged.create(size);
+		mDirty.create(size);
+		mDirtyTmp.create(size);
+		mKeptMatch.create(size);
+		validPositions.reserve(size.area());
+		for (auto& phaseHoles : holePositions) phaseHoles.reserve(((size.height + 1) / 2) * ((size.width + 1) / 2));
+	}
+
+	void InpaintingLevel::ResetTemporal()
+	{
+		firstFrame = true;
 	}
 
-	void InpaintingLevel::LoadFrame(const cv::Mat3b & color, const cv::Mat1b & mask)
+	void InpaintingLevel::LoadFrame(cv::InputArray color, const cv::Mat1b & mask, const cv::Vec2i & motion, const cv::Mat1b & exclude)
 	{
-		CreateBorderMat(color, mColor, borderSize);
+		assert(color.size() == size && mask.size() == size);
+		assert(exclude.empty() || exclude.size() == size);
+
+		// the previous frame is kept by swapping buffers, the old ones are overwritten below
+		if (!firstFrame)
+		{
+			std::swap(mColor[WO_BORDER], prevColor[WO_BORDER]);
+			std::swap(mColor[W_BORDER], prevColor[W_BORDER]);
+			std::swap(mMask[WO_BORDER], prevMask[WO_BORDER]);
+			std::swap(mMask[W_BORDER], prevMask[W_BORDER]);
+
+			// with a moving camera the previous frame and its matches are moved along, so that the
+			// temporal cost and the carried over matches refer to the same content again
+			if (motion != cv::Vec2i(0, 0))
+			{
+				ShiftContent(prevColor[WO_BORDER], shiftColorTmp, motion);
+				RefreshBorder(prevColor[W_BORDER], borderSize);
+				ShiftContent(prevMask[WO_BORDER], shiftMaskTmp, motion);
+				ShiftContent(mPosMap[WO_BORDER], shiftPosMapTmp, motion);
+			}
+		}
+
+		// the 4th byte pads every pixel to 32 bit, so patch rows and single pixels load in one go
+		if (color.type() == CV_8UC3) cv::cvtColor(color, mColor[WO_BORDER], cv::COLOR_BGR2BGRA);
+		else color.copyTo(mColor[WO_BORDER]);
+		RefreshBorder(mColor[W_BORDER], borderSize);
 		CreateBorderMat(mask, mMask, borderSize);
 
-		if (firstFrame) mPosMap[WO_BORDER] = cv::Mat2i(mColor[WO_BORDER].size());
+		// hole pixels per parity phase in row-major order, the passes only visit these
+		for (auto& phaseHoles : holePositions) phaseHoles.clear();
+		cv::Rect holeRect;
+		for (int r = 0; r < mMask[WO_BORDER].rows; ++r)
+		{
+			auto ptrMask = mMask[WO_BORDER].ptr<uchar>(r);
+			for (int c = 0; c < mMask[WO_BORDER].cols; ++c)
+			{
+				if (ptrMask[c] != 0) continue;
+				holePositions[(r % 2) * 2 + c % 2].push_back(cv::Vec2i(r, c));
+				holeRect |= cv::Rect(c, r, 1, 1);
+			}
+		}
+
+		// excluded pixels are known for the holes but their color isn't, so they are no source
+		const cv::Mat1b* sources = mMask;
+		if (!exclude.empty())
+		{
+			CreateBorderMat(exclude, mSources, borderSize);
+			for (int r = 0; r < mSources[W_BORDER].rows; ++r)
+			{
+				auto ptrMask = mMask[W_BORDER].ptr<uchar>(r);
+				auto ptrSources = mSources[W_BORDER].ptr<uchar>(r);
+				for (int c = 0; c < mSources[W_BORDER].cols; ++c) ptrSources[c] = ptrSources[c] != 0 ? 0 : ptrMask[c];
+			}
+			sources = mSources;
+		}
+
+		// a source patch is valid if its whole window is known (5x5 erosion of the mask), so the
+		// costs never have to look at the mask. Tiny levels without any such patch fall back to the
+		// validity of the center pixel, within the same source region.
+		const bool restrict = params.sourceMargin >= 0.0f && !holeRect.empty();
+		UpdatePatchValidity(sources[W_BORDER]);
+		if (restrict) RestrictSources(mPatchValidBuf, holeRect);
+		if (cv::countNonZero(mPatchValidBuf) != 0) mPatchValid = mPatchValidBuf;
+		else if (restrict)
+		{
+			sources[WO_BORDER].copyTo(mPatchValidBuf);
+			RestrictSources(mPatchValidBuf, holeRect);
+			mPatchValid = mPatchValidBuf;
+		}
+		else mPatchValid = sources[WO_BORDER];
+
+		// sources are drawn from this list, so sampling costs the same no matter how much is masked
+		validPositions.clear();
+		for (int r = 0; r < mPatchValid.rows; ++r)
+		{
+			auto ptrValid = mPatchValid.ptr<uchar>(r);
+			for (int c = 0; c < mPatchValid.cols; ++c)
+			{
+				if (ptrValid[c] == 255) validPositions.push_back(cv::Vec2s(short(r), short(c)));
+			}
+		}
+
+		const int maxR = mPosMap[WO_BORDER].rows - 1;
+		const int maxC = mPosMap[WO_BORDER].cols - 1;
 		for (int r = 0; r < mPosMap[WO_BORDER].rows; ++r)
 		{
 			for (int c = 0; c < mPosMap[WO_BORDER].cols; ++c)
 			{
-				if (!firstFrame) {
-					if (mMask[WO_BORDER](r, c) == 0 && prevMask[WO_BORDER](r, c) != 0) {
-						mPosMap[WO_BORDER](r, c) = GetValidRandPos();
-					}
-					else if (mMask[WO_BORDER](r, c) != 0 && prevMask[WO_BORDER](r, c) == 0) {
-						mPosMap[WO_BORDER](r, c) = cv::Vec2i(r, c);
-					}
+				mKeptMatch(r, c) = 0;
+
+				// without any source the holes keep pointing to themselves, Run() leaves them to the other levels
+				if (validPositions.empty() || mMask[WO_BORDER](r, c) != 0) {
+					mPosMap[WO_BORDER](r, c) = cv::Vec2s(short(r), short(c));
 					continue;
 				}
 
-				if (mMask[WO_BORDER](r, c) == 0) mPosMap[WO_BORDER](r, c) = GetValidRandPos();
-				else mPosMap[WO_BORDER](r, c) = cv::Vec2i(r, c);
+				// new holes start from random matches
+				if (firstFrame || prevMask[WO_BORDER](r, c) != 0) {
+					mPosMap[WO_BORDER](r, c) = ToNnf(GetValidRandPos(mt));
+					continue;
+				}
+
+				// holes of the previous frame keep their match (moved with the content), unless the source isn't valid anymore
+				const cv::Vec2i moved = FromNnf(mPosMap[WO_BORDER](r, c)) + motion;
+				cv::Vec2i ref;
+				ref[0] = std::min(std::max(moved[0], 0), maxR);
+				ref[1] = std::min(std::max(moved[1], 0), maxC);
+				const bool valid = mPatchValid(ref) != 0;
+				mPosMap[WO_BORDER](r, c) = valid ? ToNnf(ref) : ToNnf(GetValidRandPos(mt));
+
+				// only a match that came along unchanged from a pixel inside the previous frame is the previous one
+				const bool uncovered = r - motion[0] < 0 || r - motion[0] > maxR || c - motion[1] < 0 || c - motion[1] > maxC;
+				mKeptMatch(r, c) = valid && ref == moved && !uncovered ? 255 : 0;
 			}
 		}
 
-		CreateBorderMat(mPosMap[WO_BORDER], mPosMap, borderSizePosMap);
+		if (params.incremental && !firstFrame && !validPositions.empty()) SelectDirtyHoles();
+
+		RefreshBorder(mPosMap[W_BORDER], borderSizePosMap);
 	}
 
 	void InpaintingLevel::Run()
 	{
 		const float thDist = std::pow(std::max(mColor[WO_BORDER].cols, mColor[WO_BORDER].rows) * params.threshDist, 2.0f);
 
-		for (int i = 0; i < params.maxItr; ++i)
+		// pick the specialized cost evaluation once, the iterations don't branch on the parameters anymore
+		// (a level without any source is left to the other levels)
+		assert(windowSize == 5);
+		if (!validPositions.empty())
 		{
-			FwdUpdate(thDist);
-			BwdUpdate(thDist);
-			Inpaint();
+			if (params.costMode != CostMode::Rgb) UpdateLuma();
+			if (firstFrame || ToCostWeight(params.beta) == CostWeight::Zero) DispatchAlpha<5, false, CostWeight::Any>(thDist);
+			else if (ToCostWeight(params.beta) == CostWeight::One) DispatchAlpha<5, true, CostWeight::One>(thDist);
+			else DispatchAlpha<5, true, CostWeight::Any>(thDist);
 		}
 
-		prevMask[WO_BORDER] = mMask[WO_BORDER].clone();
-		prevColor[W_BORDER] = mColor[W_BORDER].clone();
 		firstFrame = false;
 	}
 
-	cv::Mat3b * InpaintingLevel::GetColorPtr()
+	void InpaintingLevel::Gather()
+	{
+		Inpaint();
+		firstFrame = false;
+	}
+
+	void InpaintingLevel::UpsampleFrom(const InpaintingLevel & upper)
+	{
+		// A hole pixel takes the match of its parent scaled to this level, offset by its position
+		// within the 2x2 block, and the bilinearly upsampled color (weights 3/4 and 1/4 per axis as
+		// for cv::INTER_LINEAR at 2x). Everything else keeps the loaded frame.
+		const cv::Mat4b& colorUpper = upper.mColor[WO_BORDER];
+		const cv::Mat2s& posMapUpper = upper.mPosMap[WO_BORDER];
+		const int maxR = colorUpper.rows - 1;
+		const int maxC = colorUpper.cols - 1;
+
+		for (const auto& phaseHoles : holePositions)
+		{
+			const int numHoles = int(phaseHoles.size());
+#pragma omp parallel for schedule(static)
+			for (int i = 0; i < numHoles; ++i)
+			{
+				const cv::Vec2i& target = phaseHoles[i];
+				const int r0 = std::min(target[0] / 2, maxR);
+				const int c0 = std::min(target[1] / 2, maxC);
+				const int r1 = std::min(std::max(target[0] % 2 != 0 ? r0 + 1 : r0 - 1, 0), maxR);
+				const int c1 = std::min(std::max(target[1] % 2 != 0 ? c0 + 1 : c0 - 1, 0), maxC);
+
+				const cv::Vec2s& parentRef = posMapUpper(r0, c0);
+				mPosMap[WO_BORDER](target) = cv::Vec2s(short(parentRef[0] * 2 + target[0] % 2), short(parentRef[1] * 2 + target[1] % 2));
+
+				const cv::Vec4b& p00 = colorUpper(r0, c0);
+				const cv::Vec4b& p01 = colorUpper(r0, c1);
+				const cv::Vec4b& p10 = colorUpper(r1, c0);
+				const cv::Vec4b& p11 = colorUpper(r1, c1);
+				cv::Vec4b& dst = mColor[WO_BORDER](target);
+				for (int k = 0; k < 3; ++k) dst[k] = uchar((9 * p00[k] + 3 * (p01[k] + p10[k]) + p11[k] + 8) >> 4);
+			}
+		}
+
+		// holes next to the frame edge are mirrored into the borders the costs read
+		RefreshBorder(mColor[W_BORDER], borderSize);
+		RefreshBorder(mPosMap[W_BORDER], borderSizePosMap);
+	}
+
+	template<int WindowSize, bool Temporal, CostWeight Beta>
+	void InpaintingLevel::DispatchAlpha(const float thDist)
+	{
+		switch (ToCostWeight(params.alpha))
+		{
+		case CostWeight::Zero: DispatchMode<WindowSize, Temporal, CostWeight::Zero, Beta>(thDist); break;
+		case CostWeight::One: DispatchMode<WindowSize, Temporal, CostWeight::One, Beta>(thDist); break;
+		default: DispatchMode<WindowSize, Temporal, CostWeight::Any, Beta>(thDist); break;
+		}
+	}
+
+	template<int WindowSize, bool Temporal, CostWeight Alpha, CostWeight Beta>
+	void InpaintingLevel::DispatchMode(const float thDist)
+	{
+		switch (params.costMode)
+		{
+		case CostMode::Luma: Iterate<CostModel<WindowSize, Temporal, Alpha, Beta, CostMode::Luma>>(thDist); break;
+		case CostMode::LumaChromaRefine: Iterate<CostModel<WindowSize, Temporal, Alpha, Beta, CostMode::LumaChromaRefine>>(thDist); break;
+		default: Iterate<CostModel<WindowSize, Temporal, Alpha, Beta, CostMode::Rgb>>(thDist); break;
+		}
+	}
+
+	template<class Model>
+	void InpaintingLevel::Iterate(const float thDist)
+	{
+		for (int i = 0; i < params.maxItr; ++i)
+		{
+			const double cost = UpdateCostMap<Model>(thDist);
+			const PassStats fwd = FwdUpdate<Model>(thDist);
+			const PassStats bwd = BwdUpdate<Model>(thDist);
+			Inpaint();
+
+			// converged: nothing moved or the matches hardly got better
+			if (params.minImprovement > 0.0f)
+			{
+				if (fwd.changed + bwd.changed == 0) break;
+				if (fwd.improvement + bwd.improvement < params.minImprovement * cost) break;
+			}
+		}
+	}
+
+	cv::Mat4b * InpaintingLevel::GetColorPtr()
 	{
 		return &(mColor[WO_BORDER]);
 	}
@@ -82,7 +341,7 @@ namespace inpainting
 		return &(mMask[WO_BORDER]);
 	}
 
-	cv::Mat2i * InpaintingLevel::GetPosMapPtr()
+	cv::Mat2s * InpaintingLevel::GetPosMapPtr()
 	{
 		return &(mPosMap[WO_BORDER]);
 	}
@@ -92,241 +351,549 @@ namespace inpainting
 		return size;
 	}
 
+	size_t InpaintingLevel::BytesPerPixel(CostMode costMode)
+	{
+		// current, previous and shifted color; masks, sources, validity and dirty maps; matches and
+		// their shifted copy; costs; the hole and source lists, both reserved for the whole level
+		size_t bytes = 3 * sizeof(cv::Vec4b) + 9 * sizeof(uchar) + 3 * sizeof(cv::Vec2s) + sizeof(float) + sizeof(cv::Vec2i);
+		// current and previous luma, the full color costs
+		if (costMode != CostMode::Rgb) bytes += 2 * sizeof(uchar);
+		if (costMode == CostMode::LumaChromaRefine) bytes += sizeof(float);
+		return bytes;
+	}
+
 	void InpaintingLevel::Inpaint()
 	{
-		for (int r = 0; r < mColor[WO_BORDER].rows; ++r)
+		const bool luma = params.costMode != CostMode::Rgb;
+		for (const auto& phaseHoles : holePositions)
 		{
-			auto ptrColor = mColor[WO_BORDER].ptr<cv::Vec3b>(r);
-			auto ptrPosMap = mPosMap[WO_BORDER].ptr<cv::Vec2i>(r);
-			for (int c = 0; c < mColor[WO_BORDER].cols; ++c)
+			for (const auto& target : phaseHoles)
 			{
-				ptrColor[c] = mColor[WO_BORDER](ptrPosMap[c]);
+				const cv::Vec2i ref = FromNnf(mPosMap[WO_BORDER](target));
+				mColor[WO_BORDER](target) = mColor[WO_BORDER](ref);
+				if (luma) mLuma[WO_BORDER](target) = mLuma[WO_BORDER](ref);
 			}
 		}
 	}
 
-	cv::Vec2i InpaintingLevel::GetValidRandPos()
+	template<class RandomEngine>
+	cv::Vec2i InpaintingLevel::GetValidRandPos(RandomEngine& rng)
 	{
-		cv::Vec2i p;
-		do {
-			p = cv::Vec2i(rRand(mt), cRand(mt));
-		} while (mMask[WO_BORDER](p) != 255);
+		assert(!validPositions.empty());
+		std::uniform_int_distribution<int> idxRand(0, int(validPositions.size()) - 1);
+		return FromNnf(validPositions[idxRand(rng)]);
+	}
+
+	template<class RandomEngine>
+	cv::Vec2i InpaintingLevel::GetLocalRandPos(const cv::Vec2i& center, int radius, RandomEngine& rng)
+	{
+		// the window is cut at the level border, invalid sources are rejected by the cost
+		std::uniform_int_distribution<int> rowRand(std::max(center[0] - radius, 0), std::min(center[0] + radius, size.height - 1));
+		std::uniform_int_distribution<int> colRand(std::max(center[1] - radius, 0), std::min(center[1] + radius, size.width - 1));
+		const int r = rowRand(rng);
+		return cv::Vec2i(r, colRand(rng));
+	}
 
-		return p;
+	unsigned int InpaintingLevel::PixelSeed(const cv::Vec2i& target) const
+	{
+		unsigned int h = levelSeed;
+		for (unsigned int v : { passCount, static_cast<unsigned int>(target[0]), static_cast<unsigned int>(target[1]) })
+		{
+			h ^= v + 0x9E3779B9u + (h << 6) + (h >> 2);
+		}
+		// avalanche, so neighbouring pixels get unrelated streams
+		h ^= h >> 16;
+		h *= 0x85EBCA6Bu;
+		h ^= h >> 13;
+		h *= 0xC2B2AE35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	void InpaintingLevel::AllocBorderMat(cv::Mat* arr, const cv::Size borderedSize, int borderSize)
+	{
+		arr[W_BORDER].create(borderedSize, arr[W_BORDER].type());
+		arr[WO_BORDER] = cv::Mat(arr[W_BORDER], cv::Rect(borderSize, borderSize, borderedSize.width - 2 * borderSize, borderedSize.height - 2 * borderSize));
+	}
+
+	void InpaintingLevel::AllocColorMat(cv::Mat4b* arr, const cv::Size borderedSize, int borderSize)
+	{
+		// the rows of the bordered buffer start on 16 byte boundaries (4 pixels)
+		if (arr[W_BORDER].size() != borderedSize)
+		{
+			cv::Mat4b buffer(borderedSize.height, (borderedSize.width + 3) / 4 * 4);
+			arr[W_BORDER] = buffer(cv::Rect(cv::Point(0, 0), borderedSize));
+		}
+		arr[WO_BORDER] = arr[W_BORDER](cv::Rect(borderSize, borderSize, borderedSize.width - 2 * borderSize, borderedSize.height - 2 * borderSize));
 	}
 
 	void InpaintingLevel::CreateBorderMat(cv::InputArray src, cv::Mat* arr, int borderSize)
 	{
+		// writes into the preallocated buffer, copyMakeBorder only reallocates if the size changed
 		cv::copyMakeBorder(src, arr[W_BORDER], borderSize, borderSize, borderSize, borderSize, cv::BORDER_REFLECT); 
 		arr[WO_BORDER] = cv::Mat(arr[W_BORDER], cv::Rect(borderSize, borderSize, src.cols(), src.rows()));
 	}
 
-	void InpaintingLevel::FwdUpdate(const float thDist)
+	template<typename T>
+	void InpaintingLevel::RefreshBorder(cv::Mat_<T>& arr, int borderSize)
+	{
+		// same layout as cv::BORDER_REFLECT, written in place
+		const int rows = arr.rows - 2 * borderSize;
+		const int cols = arr.cols - 2 * borderSize;
+		for (int r = borderSize; r < borderSize + rows; ++r)
+		{
+			T* ptr = arr.template ptr<T>(r);
+			for (int k = 0; k < borderSize; ++k)
+			{
+				ptr[borderSize - 1 - k] = ptr[borderSize + k];
+				ptr[borderSize + cols + k] = ptr[borderSize + cols - 1 - k];
+			}
+		}
+		for (int k = 0; k < borderSize; ++k)
+		{
+			std::copy_n(arr.template ptr<T>(borderSize + k), arr.cols, arr.template ptr<T>(borderSize - 1 - k));
+			std::copy_n(arr.template ptr<T>(borderSize + rows - 1 - k), arr.cols, arr.template ptr<T>(borderSize + rows + k));
+		}
+	}
+
+	template<typename T>
+	void InpaintingLevel::ShiftContent(cv::Mat_<T>& arr, cv::Mat_<T>& tmp, const cv::Vec2i & motion)
+	{
+		// the content moves by motion, uncovered pixels repeat the nearest edge
+		arr.copyTo(tmp);
+		const int maxR = arr.rows - 1;
+		const int maxC = arr.cols - 1;
+		for (int r = 0; r < arr.rows; ++r)
+		{
+			const T* ptrSrc = tmp.template ptr<T>(std::min(std::max(r - motion[0], 0), maxR));
+			T* ptrDst = arr.template ptr<T>(r);
+			for (int c = 0; c < arr.cols; ++c) ptrDst[c] = ptrSrc[std::min(std::max(c - motion[1], 0), maxC)];
+		}
+	}
+
+	void InpaintingLevel::RestrictSources(cv::Mat1b& valid, const cv::Rect& holeRect)
 	{
-		const auto scAlpha = params.alpha;
-		const auto acAlpha = 1.0f - params.alpha;
-		const auto excBeta = params.beta;
-		const auto sacBeta = 1.0f - params.beta;
+		// only patches within sourceMargin around the holes can serve as a source
+		const int margin = int(params.sourceMargin * std::max(size.width, size.height));
+		const cv::Rect region = cv::Rect(holeRect.x - margin, holeRect.y - margin, holeRect.width + 2 * margin, holeRect.height + 2 * margin)
+			& cv::Rect(cv::Point(0, 0), size);
+		for (int r = 0; r < valid.rows; ++r)
+		{
+			auto ptrValid = valid.ptr<uchar>(r);
+			if (r < region.y || r >= region.y + region.height)
+			{
+				std::fill_n(ptrValid, valid.cols, uchar(0));
+				continue;
+			}
+			std::fill_n(ptrValid, region.x, uchar(0));
+			std::fill(ptrValid + region.x + region.width, ptrValid + valid.cols, uchar(0));
+		}
+	}
 
-#pragma omp parallel for // NOTE: This is not thread-safe
-		for (int r = 0; r < mColor[WO_BORDER].rows; ++r)
+	void InpaintingLevel::SelectDirtyHoles()
+	{
+		// changes are pixels that entered or left the holes and known pixels whose color changed
+		const int thresh = params.colorChangeThresh;
+		for (int r = 0; r < size.height; ++r)
 		{
 			auto ptrMask = mMask[WO_BORDER].ptr<uchar>(r);
-			auto ptrPosMap = mPosMap[WO_BORDER].ptr<cv::Vec2i>(r);
-			for (int c = 0; c < mColor[WO_BORDER].cols; ++c)
+			auto ptrPrevMask = prevMask[WO_BORDER].ptr<uchar>(r);
+			auto ptrColor = mColor[WO_BORDER].ptr<cv::Vec4b>(r);
+			auto ptrPrevColor = prevColor[WO_BORDER].ptr<cv::Vec4b>(r);
+			auto ptrChanged = mChanged.ptr<uchar>(r);
+			for (int c = 0; c < size.width; ++c)
 			{
-				if (ptrMask[c] != 0) continue;
-				cv::Vec2i target(r, c);
-				cv::Vec2i ref = ptrPosMap[target[1]];
-				cv::Vec2i top = target + toUp;
-				cv::Vec2i left = target + toLeft;
-				if (top[0] < 0) top[0] = 0;
-				if (left[1] < 0) left[1] = 0;
-				cv::Vec2i topRef = mPosMap[WO_BORDER](top) + toDown;
-				cv::Vec2i leftRef = mPosMap[WO_BORDER](left) + toRight;
-				if (topRef[0] >= mColor[WO_BORDER].rows) topRef[0] = mPosMap[WO_BORDER](top)[0];
-				if (leftRef[1] >= mColor[WO_BORDER].cols) leftRef[1] = mPosMap[WO_BORDER](left)[1];
-
-				// propagate
-				float cost = scAlpha * CalcSptCost(target, ref, thDist) + acAlpha * CalcAppCost(target, ref);
-				if (!firstFrame) cost = sacBeta * cost + excBeta * CalcExtAppCost(target, ref);
-
-				float costTop = FLT_MAX, costLeft = FLT_MAX;
-
-				if (mMask[WO_BORDER](top) == 0 && mMask[WO_BORDER](topRef) != 0)
-				{
-					costTop = scAlpha * CalcSptCost(target, topRef, thDist) + acAlpha * CalcAppCost(target, topRef);
-					if (!firstFrame) costTop = sacBeta * costTop + excBeta * CalcExtAppCost(target, topRef);
-				}
-				if (mMask[WO_BORDER](left) == 0 && mMask[WO_BORDER](leftRef) != 0)
+				bool changed = (ptrMask[c] == 0) != (ptrPrevMask[c] == 0);
+				if (!changed && ptrMask[c] != 0)
 				{
-					costLeft = scAlpha * CalcSptCost(target, leftRef, thDist) + acAlpha * CalcAppCost(target, leftRef);
-					if (!firstFrame) costLeft = sacBeta * costLeft + excBeta * CalcExtAppCost(target, leftRef);
+					for (int k = 0; k < 3; ++k) changed |= std::abs(int(ptrColor[c][k]) - int(ptrPrevColor[c][k])) > thresh;
 				}
+				ptrChanged[c] = changed ? 255 : 0;
+			}
+		}
+		DilateChanges(windowSize / 2);
 
-				if (costTop < cost && costTop < costLeft)
-				{
-					cost = costTop;
-					ptrPosMap[target[1]] = topRef;
-				}
-				else if (costLeft < cost)
-				{
-					cost = costLeft;
-					ptrPosMap[target[1]] = leftRef;
-				}
+		// A hole is optimized again if a change lies within its patch or within the patch of its
+		// previous match, or if that match couldn't be carried over. The others get their previous
+		// result back and are left alone by the passes.
+		for (auto& phaseHoles : holePositions)
+		{
+			auto end = std::remove_if(phaseHoles.begin(), phaseHoles.end(), [this](const cv::Vec2i& target) {
+				if (mKeptMatch(target) == 0 || mDirty(target) != 0 || mDirty(FromNnf(mPosMap[WO_BORDER](target))) != 0) return false;
+				mColor[WO_BORDER](target) = prevColor[WO_BORDER](target);
+				return true;
+			});
+			phaseHoles.erase(end, phaseHoles.end());
+		}
+		RefreshBorder(mColor[W_BORDER], borderSize);
+	}
 
-				// random search
-				int itrNum = 0;
-				cv::Vec2i refRand;
-				float costRand = FLT_MAX;
-				do {
-					refRand = GetValidRandPos();
-					costRand = scAlpha * CalcSptCost(target, refRand, thDist) + acAlpha * CalcAppCost(target, refRand);
-					if (!firstFrame) costRand = sacBeta * costRand + excBeta * CalcExtAppCost(target, refRand);
-					//if (!reloadPosMap) costRand /= 1 - params.beta;
-				} while (costRand >= cost && ++itrNum < params.maxRandSearchItr);
-
-				if (costRand < cost) ptrPosMap[target[1]] = refRand;
+	void InpaintingLevel::DilateChanges(int radius)
+	{
+		// separable maximum over a (2 * radius + 1)^2 window clamped to the level, into the
+		// preallocated buffers (cv::dilate would set up its filter engine every frame)
+		for (int r = 0; r < size.height; ++r)
+		{
+			auto ptrChanged = mChanged.ptr<uchar>(r);
+			auto ptrTmp = mDirtyTmp.ptr<uchar>(r);
+			for (int c = 0; c < size.width; ++c)
+			{
+				const int end = std::min(c + radius, size.width - 1);
+				uchar m = 0;
+				for (int k = std::max(c - radius, 0); k <= end; ++k) m = std::max(m, ptrChanged[k]);
+				ptrTmp[c] = m;
+			}
+		}
+		for (int r = 0; r < size.height; ++r)
+		{
+			auto ptrDirty = mDirty.ptr<uchar>(r);
+			std::fill_n(ptrDirty, size.width, uchar(0));
+			const int end = std::min(r + radius, size.height - 1);
+			for (int k = std::max(r - radius, 0); k <= end; ++k)
+			{
+				auto ptrTmp = mDirtyTmp.ptr<uchar>(k);
+				for (int c = 0; c < size.width; ++c) ptrDirty[c] = std::max(ptrDirty[c], ptrTmp[c]);
 			}
 		}
 	}
 
-	void InpaintingLevel::BwdUpdate(const float thDist)
+	void InpaintingLevel::UpdateLuma()
 	{
-		const auto scAlpha = params.alpha;
-		const auto acAlpha = 1.0f - params.alpha;
-		const auto excBeta = params.beta;
-		const auto sacBeta = 1.0f - params.beta;
+		// once per Run() on the bordered buffers, so the mirrored borders come along; Inpaint() keeps
+		// the holes up to date afterwards
+		cv::cvtColor(mColor[W_BORDER], mLuma[W_BORDER], cv::COLOR_BGRA2GRAY);
+		if (!firstFrame) cv::cvtColor(prevColor[W_BORDER], prevLuma[W_BORDER], cv::COLOR_BGRA2GRAY);
+	}
 
-#pragma omp parallel for // NOTE: This is not thread-safe
-		for (int r = mColor[WO_BORDER].rows - 1; r >= 0; --r)
+	void InpaintingLevel::UpdatePatchValidity(const cv::Mat1b& sources)
+	{
+		// separable 5x5 minimum of the bordered mask, first along the rows, then along the columns
+		const int cols = mPatchValidBuf.cols;
+		for (int r = 0; r < sources.rows; ++r)
 		{
-			auto ptrMask = mMask[WO_BORDER].ptr<uchar>(r);
-			auto ptrPosMap = mPosMap[WO_BORDER].ptr<cv::Vec2i>(r);
-			for (int c = mColor[WO_BORDER].cols - 1; c >= 0; --c)
+			auto ptrMask = sources.ptr<uchar>(r);
+			auto ptrTmp = mPatchValidTmp.ptr<uchar>(r);
+			for (int c = 0; c < cols; ++c)
 			{
-				if (ptrMask[c] == 0)
-				{
-					cv::Vec2i target(r, c);
-					cv::Vec2i ref = ptrPosMap[target[1]];
-					cv::Vec2i bottom = target + toDown;
-					cv::Vec2i right = target + toRight;
-					if (bottom[0] >= mColor[WO_BORDER].rows) bottom[0] = target[0];
-					if (right[1] >= mColor[WO_BORDER].cols) right[1] = target[1];
-					cv::Vec2i bottomRef = mPosMap[WO_BORDER](bottom) + toUp;
-					cv::Vec2i rightRef = mPosMap[WO_BORDER](right) + toLeft;
-					if (bottomRef[0] < 0) bottomRef[0] = 0;
-					if (rightRef[1] < 0) rightRef[1] = 0;
-
-					// propagate
-					float cost = scAlpha * CalcSptCost(target, ref, thDist) + acAlpha * CalcAppCost(target, ref);
-					if (!firstFrame) cost = sacBeta * cost + excBeta * CalcExtAppCost(target, ref);
-
-					float costDown = FLT_MAX, costRight = FLT_MAX;
-
-					if (mMask[WO_BORDER](bottom) == 0 && mMask[WO_BORDER](bottomRef) != 0)
-					{
-						costDown = scAlpha * CalcSptCost(target, bottomRef, thDist) + acAlpha * CalcAppCost(target, bottomRef);
-						if (!firstFrame) costDown = sacBeta * costDown + excBeta * CalcExtAppCost(target, bottomRef);
-					}
-					if (mMask[WO_BORDER](right) == 0 && mMask[WO_BORDER](rightRef) != 0)
-					{
-						costRight = scAlpha * CalcSptCost(target, rightRef, thDist) + acAlpha * CalcAppCost(target, rightRef);
-						if (!firstFrame) costRight = sacBeta * costRight + excBeta * CalcExtAppCost(target, rightRef);
-					}
-
-					if (costDown < cost && costDown < costRight)
-					{
-						cost = costDown;
-						ptrPosMap[target[1]] = bottomRef;
-					}
-					else if (costRight < cost)
-					{
-						cost = costRight;
-						ptrPosMap[target[1]] = rightRef;
-					}
-
-					// random search
-					int itrNum = 0;
-					cv::Vec2i refRand;
-					float costRand = FLT_MAX;
-					do {
-						refRand = GetValidRandPos();
-						costRand = scAlpha * CalcSptCost(target, refRand, thDist) + acAlpha * CalcAppCost(target, refRand);
-						if (!firstFrame) costRand = sacBeta * costRand + excBeta * CalcExtAppCost(target, refRand);
-					} while (costRand >= cost && ++itrNum < params.maxRandSearchItr);
-
-					if (costRand < cost) ptrPosMap[target[1]] = refRand;
-				}
+				uchar m = ptrMask[c];
+				for (int k = 1; k < windowSize; ++k) m = std::min(m, ptrMask[c + k]);
+				ptrTmp[c] = m;
+			}
+		}
+		for (int r = 0; r < mPatchValidBuf.rows; ++r)
+		{
+			auto ptrValid = mPatchValidBuf.ptr<uchar>(r);
+			std::copy_n(mPatchValidTmp.ptr<uchar>(r), cols, ptrValid);
+			for (int k = 1; k < windowSize; ++k)
+			{
+				auto ptrTmp = mPatchValidTmp.ptr<uchar>(r + k);
+				for (int c = 0; c < cols; ++c) ptrValid[c] = std::min(ptrValid[c], ptrTmp[c]);
 			}
 		}
 	}
 
-	float InpaintingLevel::CalcSptCost(const cv::Vec2i & target, const cv::Vec2i & ref, float maxDist, float w)
+	// The cost of a match depends on the target patch, which changes with every Inpaint(), so the
+	// costs are refreshed once per iteration. The passes themselves only evaluate new candidates.
+	template<class Model>
+	double InpaintingLevel::UpdateCostMap(const float thDist)
 	{
-		const float normFactor = maxDist * 2.0f;
+		long long total = 0;
+		for (const auto& phaseHoles : holePositions)
+		{
+			const int numHoles = int(phaseHoles.size());
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:total)
+			for (int i = 0; i < numHoles; ++i)
+			{
+				const cv::Vec2i& target = phaseHoles[i];
+				const cv::Vec2i ref = FromNnf(mPosMap[WO_BORDER](target));
+				mCostMap(target) = CalcCost<Model>(target, ref, thDist);
+				if (Model::mode == CostMode::LumaChromaRefine) mRefineCostMap(target) = CalcCost<Model, false>(target, ref, thDist);
+				if (IsUsableCost(mCostMap(target))) total += ToFixedCost(mCostMap(target));
+			}
+		}
+		return double(total) / fixedCostScale;
+	}
 
-		float sc = 0.0f;
-		for (const auto& v : vSptAdj)
+	// Propagation reads the top/left (bottom/right) neighbours of a pixel and the spatial cost
+	// reads the matches of all eight neighbours. Pixels with the same row and column parity
+	// never read each other's entries, so each of the four parity phases is updated in parallel
+	// without races. Random numbers come from a per-pixel stream, which keeps the result
+	// identical for a fixed seed, independent of the number of threads.
+	template<class Model>
+	PassStats InpaintingLevel::FwdUpdate(const float thDist)
+	{
+		passCount++;
+
+		int changed = 0;
+		long long improvement = 0;
+		for (int phase = 0; phase < 4; ++phase)
 		{
-			cv::Vec2f diff((ref + v) - mPosMap[W_BORDER](target + cv::Vec2i(borderSizePosMap, borderSizePosMap) + v));
-			sc += std::min(diff.dot(diff), maxDist);
+			const auto& phaseHoles = holePositions[phase];
+			const int numHoles = int(phaseHoles.size());
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:changed, improvement)
+			for (int i = 0; i < numHoles; ++i)
+			{
+				const cv::Vec2i& target = phaseHoles[i];
+				std::minstd_rand rng(PixelSeed(target));
+				const float before = mCostMap(target);
+				FwdUpdatePixel<Model>(target, thDist, rng);
+				CountUpdate(before, mCostMap(target), changed, improvement);
+			}
 		}
 
-		return sc * w / normFactor;
+		PassStats stats;
+		stats.changed = changed;
+		stats.improvement = double(improvement) / fixedCostScale;
+		return stats;
 	}
 
-	float InpaintingLevel::CalcAppCost(const cv::Vec2i & target, const cv::Vec2i & ref, float w)
+	template<class Model>
+	PassStats InpaintingLevel::BwdUpdate(const float thDist)
 	{
-		const float normFctor = 255.0f * 255.0f * 3.0f;
+		passCount++;
 
-		float ac = 0.0f;
-		for (int r = 0; r < windowSize; ++r)
+		int changed = 0;
+		long long improvement = 0;
+		for (int phase = 3; phase >= 0; --phase)
 		{
-			uchar* ptrMask = mMask[W_BORDER].ptr<uchar>(r + ref[0]);
-			cv::Vec3b* ptrTargetColor = mColor[W_BORDER].ptr<cv::Vec3b>(r + target[0]);
-			cv::Vec3b* ptrRefColor = mColor[W_BORDER].ptr<cv::Vec3b>(r + ref[0]);
-			for (int c = 0; c < windowSize; ++c)
+			const auto& phaseHoles = holePositions[phase];
+#pragma omp parallel for schedule(dynamic, 64) reduction(+:changed, improvement)
+			for (int i = int(phaseHoles.size()) - 1; i >= 0; --i)
 			{
-				if (ptrMask[c + ref[1]] == 0)
-				{
-					ac += FLT_MAX / 25.0f;
-				}
-				else
-				{
-					cv::Vec3f diff(cv::Vec3f(ptrTargetColor[c + target[1]]) - cv::Vec3f(ptrRefColor[c + ref[1]]));
-					ac += diff.dot(diff);
-				}
+				const cv::Vec2i& target = phaseHoles[i];
+				std::minstd_rand rng(PixelSeed(target));
+				const float before = mCostMap(target);
+				BwdUpdatePixel<Model>(target, thDist, rng);
+				CountUpdate(before, mCostMap(target), changed, improvement);
 			}
 		}
 
-		return ac * w / normFctor;
+		PassStats stats;
+		stats.changed = changed;
+		stats.improvement = double(improvement) / fixedCostScale;
+		return stats;
 	}
 
-	float InpaintingLevel::CalcExtAppCost(const cv::Vec2i & target, const cv::Vec2i & ref, float w)
+	template<class Model>
+	void InpaintingLevel::FwdUpdatePixel(const cv::Vec2i& target, const float thDist, std::minstd_rand& rng)
 	{
-		const float normFctor = 255.0f * 255.0f * 3.0f;
+		auto ptrPosMap = mPosMap[WO_BORDER].ptr<cv::Vec2s>(target[0]);
+		float& cost = mCostMap(target);
+		cv::Vec2i top = target + toUp;
+		cv::Vec2i left = target + toLeft;
+		if (top[0] < 0) top[0] = 0;
+		if (left[1] < 0) left[1] = 0;
+		cv::Vec2i topRef = FromNnf(mPosMap[WO_BORDER](top)) + toDown;
+		cv::Vec2i leftRef = FromNnf(mPosMap[WO_BORDER](left)) + toRight;
+		if (topRef[0] >= mColor[WO_BORDER].rows) topRef[0] = mPosMap[WO_BORDER](top)[0];
+		if (leftRef[1] >= mColor[WO_BORDER].cols) leftRef[1] = mPosMap[WO_BORDER](left)[1];
+
+		// propagate
+		float costTop = FLT_MAX, costLeft = FLT_MAX;
+
+		if (mMask[WO_BORDER](top) == 0 && mPatchValid(topRef) != 0)
+		{
+			costTop = CalcCost<Model>(target, topRef, thDist, cost);
+		}
+		if (mMask[WO_BORDER](left) == 0 && mPatchValid(leftRef) != 0)
+		{
+			costLeft = CalcCost<Model>(target, leftRef, thDist, std::min(cost, costTop));
+		}
 
-		float ac = 0.0f;
-		for (int r = 0; r < windowSize; ++r)
+		if (costTop < cost && costTop < costLeft && ConfirmCandidate<Model>(target, topRef, thDist))
 		{
-			uchar* ptrMask = mMask[W_BORDER].ptr<uchar>(r + ref[0]);
-			cv::Vec3b* ptrTargetColor = mColor[W_BORDER].ptr<cv::Vec3b>(r + target[0]);
-			cv::Vec3b* ptrRefColor = prevColor[W_BORDER].ptr<cv::Vec3b>(r + ref[0]);
-			for (int c = 0; c < windowSize; ++c)
+			cost = costTop;
+			ptrPosMap[target[1]] = ToNnf(topRef);
+		}
+		else if (costLeft < cost && ConfirmCandidate<Model>(target, leftRef, thDist))
+		{
+			cost = costLeft;
+			ptrPosMap[target[1]] = ToNnf(leftRef);
+		}
+
+		RandomSearch<Model>(target, thDist, rng, cost, ptrPosMap[target[1]]);
+	}
+
+	template<class Model>
+	void InpaintingLevel::BwdUpdatePixel(const cv::Vec2i& target, const float thDist, std::minstd_rand& rng)
+	{
+		auto ptrPosMap = mPosMap[WO_BORDER].ptr<cv::Vec2s>(target[0]);
+		float& cost = mCostMap(target);
+		cv::Vec2i bottom = target + toDown;
+		cv::Vec2i right = target + toRight;
+		if (bottom[0] >= mColor[WO_BORDER].rows) bottom[0] = target[0];
+		if (right[1] >= mColor[WO_BORDER].cols) right[1] = target[1];
+		cv::Vec2i bottomRef = FromNnf(mPosMap[WO_BORDER](bottom)) + toUp;
+		cv::Vec2i rightRef = FromNnf(mPosMap[WO_BORDER](right)) + toLeft;
+		if (bottomRef[0] < 0) bottomRef[0] = 0;
+		if (rightRef[1] < 0) rightRef[1] = 0;
+
+		// propagate
+		float costDown = FLT_MAX, costRight = FLT_MAX;
+
+		if (mMask[WO_BORDER](bottom) == 0 && mPatchValid(bottomRef) != 0)
+		{
+			costDown = CalcCost<Model>(target, bottomRef, thDist, cost);
+		}
+		if (mMask[WO_BORDER](right) == 0 && mPatchValid(rightRef) != 0)
+		{
+			costRight = CalcCost<Model>(target, rightRef, thDist, std::min(cost, costDown));
+		}
+
+		if (costDown < cost && costDown < costRight && ConfirmCandidate<Model>(target, bottomRef, thDist))
+		{
+			cost = costDown;
+			ptrPosMap[target[1]] = ToNnf(bottomRef);
+		}
+		else if (costRight < cost && ConfirmCandidate<Model>(target, rightRef, thDist))
+		{
+			cost = costRight;
+			ptrPosMap[target[1]] = ToNnf(rightRef);
+		}
+
+		RandomSearch<Model>(target, thDist, rng, cost, ptrPosMap[target[1]]);
+	}
+
+	template<class Model>
+	void InpaintingLevel::RandomSearch(const cv::Vec2i& target, const float thDist, std::minstd_rand& rng, float& cost, cv::Vec2s& match)
+	{
+		// PatchMatch style: windows of halving radius around the best match so far, all samples are
+		// evaluated. Without a usable match yet there is nothing to search around.
+		if (searchRadius > 0 && cost < FLT_MAX)
+		{
+			int radius = searchRadius;
+			for (int itrNum = 0; itrNum < params.maxRandSearchItr && radius > 0; ++itrNum, radius /= 2)
 			{
-				if (ptrMask[c + ref[1]] == 0)
-				{
-					ac += FLT_MAX / 25.0f;
-				}
-				else
+				const cv::Vec2i refRand = GetLocalRandPos(FromNnf(match), radius, rng);
+				const float costRand = CalcCost<Model>(target, refRand, thDist, cost);
+				if (costRand < cost && ConfirmCandidate<Model>(target, refRand, thDist))
 				{
-					cv::Vec3f diff(cv::Vec3f(ptrTargetColor[c + target[1]]) - cv::Vec3f(ptrRefColor[c + ref[1]]));
-					ac += diff.dot(diff);
+					cost = costRand;
+					match = ToNnf(refRand);
 				}
 			}
+			return;
+		}
+
+		// uniform over all sources until a better match turns up
+		int itrNum = 0;
+		cv::Vec2i refRand;
+		float costRand = FLT_MAX;
+		do {
+			refRand = GetValidRandPos(rng);
+			costRand = CalcCost<Model>(target, refRand, thDist, cost);
+		} while (costRand >= cost && ++itrNum < params.maxRandSearchItr);
+
+		if (costRand < cost && ConfirmCandidate<Model>(target, refRand, thDist))
+		{
+			cost = costRand;
+			match = ToNnf(refRand);
+		}
+	}
+
+	template<class Model>
+	bool InpaintingLevel::ConfirmCandidate(const cv::Vec2i& target, const cv::Vec2i& ref, const float thDist)
+	{
+		if (Model::mode != CostMode::LumaChromaRefine) return true;
+
+		float& refineCost = mRefineCostMap(target);
+		const float costColor = CalcCost<Model, false>(target, ref, thDist, refineCost);
+		if (costColor >= refineCost) return false;
+		refineCost = costColor;
+		return true;
+	}
+
+	float InpaintingLevel::CalcSptCost(const cv::Vec2i & target, const cv::Vec2i & ref, float maxDist, float w)
+	{
+		const float normFactor = maxDist * 2.0f;
+
+		float sc = 0.0f;
+		for (int i = 0; i < 8; ++i)
+		{
+			const cv::Vec2s& adjRef = mPosMap[W_BORDER](target[0] + borderSizePosMap + sptAdjR[i], target[1] + borderSizePosMap + sptAdjC[i]);
+			const int dr = ref[0] + sptAdjR[i] - adjRef[0];
+			const int dc = ref[1] + sptAdjC[i] - adjRef[1];
+			sc += std::min(float(dr * dr + dc * dc), maxDist);
+		}
+
+		return sc * w / normFactor;
+	}
+
+	template<class Model, bool Luma>
+	float InpaintingLevel::CalcCost(const cv::Vec2i & target, const cv::Vec2i & ref, float maxDist, float maxCost)
+	{
+		// weights collapse to constants for the degenerate cases, so unused terms are compiled out
+		const float excBeta = Model::temporal ? WeightValue<Model::beta>(params.beta) : 0.0f;
+		const float sacBeta = 1.0f - excBeta;
+		const float scAlpha = sacBeta * WeightValue<Model::alpha>(params.alpha);
+		const float acAlpha = sacBeta * (1.0f - WeightValue<Model::alpha>(params.alpha));
+		const bool onlyTemporal = Model::temporal && Model::beta == CostWeight::One;
+
+		// candidates whose patch isn't fully known are rejected up front
+		if (mPatchValid(ref) == 0) return FLT_MAX;
+
+		float cost = 0.0f;
+		if (!onlyTemporal && Model::alpha != CostWeight::Zero)
+		{
+			cost = scAlpha * CalcSptCost(target, ref, maxDist);
+		}
+		// the temporal term carries most of the weight, so it gives the tighter bound
+		if (Model::temporal)
+		{
+			const float exc = Luma
+				? CalcLumaCost<Model::windowSize>(prevLuma[W_BORDER], target, ref, (maxCost - cost) / excBeta)
+				: CalcPatchCost<Model::windowSize>(prevColor[W_BORDER], target, ref, (maxCost - cost) / excBeta);
+			if (exc == FLT_MAX) return FLT_MAX;
+			cost += excBeta * exc;
+		}
+		if (!onlyTemporal && Model::alpha != CostWeight::One)
+		{
+			const float ac = Luma
+				? CalcLumaCost<Model::windowSize>(mLuma[W_BORDER], target, ref, (maxCost - cost) / acAlpha)
+				: CalcPatchCost<Model::windowSize>(mColor[W_BORDER], target, ref, (maxCost - cost) / acAlpha);
+			if (ac == FLT_MAX) return FLT_MAX;
+			cost += acAlpha * ac;
 		}
+		return cost;
+	}
+
+	template<int WindowSize>
+	float InpaintingLevel::CalcPatchCost(const cv::Mat4b & refColor, const cv::Vec2i & target, const cv::Vec2i & ref, float maxCost)
+	{
+		const float w = 1.0f / float(WindowSize * WindowSize);
+		const float normFctor = 255.0f * 255.0f * 3.0f;
+
+		if (maxCost < 0.0f) return FLT_MAX;
+
+		const float limitF = maxCost * normFctor / w;
+		const int limit = limitF < float(INT_MAX) ? int(limitF) : INT_MAX;
+		const uchar* ptrTarget = mColor[W_BORDER].ptr<uchar>(target[0]) + 4 * target[1];
+		const uchar* ptrRef = refColor.ptr<uchar>(ref[0]) + 4 * ref[1];
+		const int ssd = WindowSize == 5
+			? patchSsd(ptrTarget, mColor[W_BORDER].step, ptrRef, refColor.step, limit)
+			: PatchSsdScalar<WindowSize>(ptrTarget, mColor[W_BORDER].step, ptrRef, refColor.step, limit);
+
+		if (ssd > limit) return FLT_MAX;
+		return ssd * w / normFctor;
+	}
+
+	template<int WindowSize>
+	float InpaintingLevel::CalcLumaCost(const cv::Mat1b & refLuma, const cv::Vec2i & target, const cv::Vec2i & ref, float maxCost)
+	{
+		const float w = 1.0f / float(WindowSize * WindowSize);
+		const float normFctor = 255.0f * 255.0f;
+
+		if (maxCost < 0.0f) return FLT_MAX;
+
+		const float limitF = maxCost * normFctor / w;
+		const int limit = limitF < float(INT_MAX) ? int(limitF) : INT_MAX;
+		const uchar* ptrTarget = mLuma[W_BORDER].ptr<uchar>(target[0]) + target[1];
+		const uchar* ptrRef = refLuma.ptr<uchar>(ref[0]) + ref[1];
+		const int ssd = WindowSize == 5
+			? lumaSsd(ptrTarget, mLuma[W_BORDER].step, ptrRef, refLuma.step, limit)
+			: PatchSsdScalar<WindowSize, 1>(ptrTarget, mLuma[W_BORDER].step, ptrRef, refLuma.step, limit);
 
-		return ac * w / normFctor;
+		if (ssd > limit) return FLT_MAX;
+		return ssd * w / normFctor;
 	}
 }
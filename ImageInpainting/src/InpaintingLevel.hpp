@@ -1,21 +1,77 @@
 #pragma once
 
 #include "opencv2/opencv.hpp"
+#include "PatchDistance.hpp"
 #include <random>
 
 namespace inpainting
 {
+	// What the appearance cost compares while searching for matches
+	enum class CostMode
+	{
+		Rgb,				// all three channels
+		Luma,				// 8 bit luma plane only, a third of the bytes per candidate
+		LumaChromaRefine	// luma, a candidate that wins on luma is confirmed with all three channels
+	};
+
 	struct InpaintingParams
 	{
-		int maxLevels = 6;			// max number of pyramid levels
+		int maxLevels = 6;			// max number of pyramid levels, the depth follows the size of the largest hole
 		int maxItr = 1;				// max iteration per pyramid level
+		int maxItrCoarse = -1;		// max iteration on all but the finest level, < 0 uses maxItr
+		int maxItrFine = -1;		// max iteration on the finest level, < 0 uses maxItr
+		int finestOptimizedLevel = 0;	// finer levels only get the upsampled matches and one gather, 0 optimizes all levels
+		float minImprovement = 0.0f;	// a level stops once a round lowers the summed cost of its holes by less than this fraction
 		int maxRandSearchItr = 1;	// max number of random sampling per pixel
 		float alpha = 0.05f;		// balancing parameter between spatial and appearance cost
+		CostMode costMode = CostMode::Rgb;	// channels of the appearance cost
 		float beta = 0.999f;		// balancing parameter between spatial/appearance and temporal cost
 		float threshDist = 0.5f;	// 0.5 means the half of the width/height is the maximum
+		float randSearchRadius = -1.0f;	// random search around the current match with halving radius (fraction of width/height as threshDist), < 0 samples the whole level
+		float sourceMargin = -1.0f;	// sources are restricted to this distance around the holes (fraction of width/height as threshDist), < 0 allows the whole level
 		int blurSize = 5;			// blur kernel size for the final composition
+		int fastInpaintRadius = 3;	// Telea/NavierStokes engines: radius around a pixel that is considered
+		unsigned int seed = 0;		// random seed, 0 means a random seed per run (non-deterministic)
+		int contextMargin = -1;		// context around the holes in pixels that is inpainted from, < 0 uses the whole frame
+		size_t tileMemoryBudget = 0;	// image: bytes the pyramid may take, larger regions are inpainted tile by tile, 0 disables tiling (VideoInpainter warns and ignores it)
+		int tileHalo = 32;			// image: context in pixels around every tile
+		bool motionCompensation = false;	// video: move the temporal state with the global camera motion
+		float sceneCutThresh = 40.0f;	// motion compensation: mean absolute gray difference after compensating the motion that resets the temporal state
+		bool incremental = false;	// video: only holes whose surroundings or source changed are optimized again, the others keep the last result
+		int colorChangeThresh = 12;	// incremental: largest channel difference of a known pixel that still counts as unchanged
+		bool resultCache = false;	// video: reuse the last result while the mask stays identical and its context unchanged
+		float cacheSadThresh = 2.0f;	// result cache: mean absolute difference of the known pixels in any 16x16 block that still counts as unchanged
+		bool splitComponents = false;	// video: inpaint holes with separate context regions independently and concurrently (contextMargin >= 0)
+		bool backgroundPlate = false;	// video: holes seen uncovered within plateMaxAge frames are filled from a motion compensated background plate, PatchMatch only fills the rest (needs motionCompensation)
+		int plateMaxAge = 30;		// background plate: frames (at most 254) a seen pixel stays usable
+		float plateMismatchThresh = 12.0f;	// background plate: mean absolute difference to the known pixels of a 16x16 block above which its holes aren't taken from the plate
+	};
+
+	// weight of a cost term, the degenerate values are resolved at compile time
+	enum class CostWeight { Zero, One, Any };
+
+	template<int WindowSize, bool Temporal, CostWeight Alpha, CostWeight Beta, CostMode Mode>
+	struct CostModel
+	{
+		static const int windowSize = WindowSize;
+		static const bool temporal = Temporal;	// false for the first frame
+		static const CostWeight alpha = Alpha;
+		static const CostWeight beta = Beta;
+		static const CostMode mode = Mode;
+	};
+
+	// what a forward or backward pass changed
+	struct PassStats
+	{
+		int changed = 0;			// hole pixels with a new match
+		double improvement = 0.0;	// summed cost decrease
 	};
 
+	// The nearest neighbour field stores positions as two int16 values (up to 32767 pixels per side),
+	// half the memory traffic of cv::Vec2i for the random reads of the spatial cost and the gather.
+	inline cv::Vec2s ToNnf(const cv::Vec2i& p) { return cv::Vec2s(short(p[0]), short(p[1])); }
+	inline cv::Vec2i FromNnf(const cv::Vec2s& p) { return cv::Vec2i(p[0], p[1]); }
+
 	class InpaintingLevel
 	{
 	public:
@@ -23,47 +79,109 @@ namespace inpainting
 		~InpaintingLevel();
 
 		void Init(const cv::Size initSize, const InpaintingParams& parameters);
-		void LoadFrame(const cv::Mat3b& color, const cv::Mat1b& mask);
+		// motion is the (rows, cols) translation of the content since the previous frame
+		// color is BGR (converted) or already BGRx
+		// exclude != 0 marks pixels that are neither filled nor used as a source (holes inpainted elsewhere)
+		void LoadFrame(cv::InputArray color, const cv::Mat1b& mask, const cv::Vec2i& motion = cv::Vec2i(0, 0), const cv::Mat1b& exclude = cv::Mat1b());
+		void ResetTemporal();	// the next frame is handled like the first one (scene cut)
 		void Run();
+		// initializes the holes from the next coarser level (upsampled matches and color)
+		void UpsampleFrom(const InpaintingLevel& upper);
+		// fills the holes from the current matches without optimizing them (instead of Run())
+		void Gather();
 
-		cv::Mat3b* GetColorPtr();
+		cv::Mat4b* GetColorPtr();	// BGRx
 		cv::Mat1b* GetMaskPtr();
-		cv::Mat2i* GetPosMapPtr();
+		cv::Mat2s* GetPosMapPtr();
 
 		cv::Size getSize();
+		static size_t BytesPerPixel(CostMode costMode);	// memory of a level per pixel, without the borders
 
 	private:
 		InpaintingParams params;
 		cv::Size size;
 		std::mt19937 mt;
-		std::uniform_int_distribution<int> cRand;
-		std::uniform_int_distribution<int> rRand;
+		unsigned int levelSeed;
+		unsigned int passCount;
+		int searchRadius;	// in pixels, 0 samples the whole level
 		const int borderSize;
 		const int borderSizePosMap;
 		const int windowSize;
 
 		enum { WO_BORDER = 0, W_BORDER = 1 };
-		cv::Mat3b mColor[2];
+		cv::Mat4b mColor[2];	// BGRx with 16 byte aligned rows, x is always 255
 		cv::Mat1b mMask[2];
-		cv::Mat2i mPosMap[2];
+		cv::Mat2s mPosMap[2];	// nearest neighbour field
+		cv::Mat1f mCostMap;		// cost of the current match of every hole pixel
+		cv::Mat1f mRefineCostMap;	// LumaChromaRefine: full color cost of the current match
+		cv::Mat1b mLuma[2];		// luma of mColor, only kept if the cost mode needs it
+		cv::Mat1b prevLuma[2];
+		cv::Mat1b mSources[2];	// mask without the excluded pixels
+		cv::Mat1b mPatchValidTmp;
+		cv::Mat1b mPatchValidBuf;
+		cv::Mat1b mPatchValid;	// != 0 if the whole patch around a pixel is known
+		std::vector<cv::Vec2s> validPositions;	// all pixels that can serve as a source
+		std::vector<cv::Vec2i> holePositions[4];	// hole pixels per (row, col) parity phase, row-major
 
 		bool firstFrame;
 		cv::Mat1b prevMask[2];
-		cv::Mat1i prevSptCostMap[2];
-		cv::Mat3b prevColor[2];
+		cv::Mat4b prevColor[2];
+		cv::Mat4b shiftColorTmp;	// scratch for moving the temporal state
+		cv::Mat1b shiftMaskTmp;
+		cv::Mat2s shiftPosMapTmp;
+		cv::Mat1b mChanged;		// incremental: pixels that changed since the previous frame
+		cv::Mat1b mDirty;		// incremental: pixels within a patch of a change
+		cv::Mat1b mDirtyTmp;
+		cv::Mat1b mKeptMatch;	// incremental: holes whose previous match was carried over unchanged
 
 		const cv::Vec2i toLeft;
 		const cv::Vec2i toRight;
 		const cv::Vec2i toUp;
 		const cv::Vec2i toDown;
-		std::vector<cv::Vec2i> vSptAdj;
+		PatchSsdFunc patchSsd;
+		PatchSsdFunc lumaSsd;
 
 		void Inpaint();
 
-		cv::Vec2i GetValidRandPos();
+		template<class RandomEngine>
+		cv::Vec2i GetValidRandPos(RandomEngine& rng);
+		template<class RandomEngine>
+		cv::Vec2i GetLocalRandPos(const cv::Vec2i& center, int radius, RandomEngine& rng);
+		void AllocBorderMat(cv::Mat* arr, const cv::Size borderedSize, int borderSize);
+		void AllocColorMat(cv::Mat4b* arr, const cv::Size borderedSize, int borderSize);
 		void CreateBorderMat(cv::InputArray src, cv::Mat* arr, int borderSize);
-		void FwdUpdate(const float thDist);
-		void BwdUpdate(const float thDist);
+		template<typename T>
+		void RefreshBorder(cv::Mat_<T>& arr, int borderSize);
+		template<typename T>
+		void ShiftContent(cv::Mat_<T>& arr, cv::Mat_<T>& tmp, const cv::Vec2i& motion);
+		void UpdatePatchValidity(const cv::Mat1b& sources);
+		void RestrictSources(cv::Mat1b& valid, const cv::Rect& holeRect);
+		void SelectDirtyHoles();
+		void DilateChanges(int radius);
+		void UpdateLuma();
+		unsigned int PixelSeed(const cv::Vec2i& target) const;
+
+		template<int WindowSize, bool Temporal, CostWeight Beta>
+		void DispatchAlpha(const float thDist);
+		template<int WindowSize, bool Temporal, CostWeight Alpha, CostWeight Beta>
+		void DispatchMode(const float thDist);
+		template<class Model>
+		void Iterate(const float thDist);
+		template<class Model>
+		double UpdateCostMap(const float thDist);
+		template<class Model>
+		PassStats FwdUpdate(const float thDist);
+		template<class Model>
+		PassStats BwdUpdate(const float thDist);
+		template<class Model>
+		void FwdUpdatePixel(const cv::Vec2i& target, const float thDist, std::minstd_rand& rng);
+		template<class Model>
+		void BwdUpdatePixel(const cv::Vec2i& target, const float thDist, std::minstd_rand& rng);
+		template<class Model>
+		void RandomSearch(const cv::Vec2i& target, const float thDist, std::minstd_rand& rng, float& cost, cv::Vec2s& match);
+		// LumaChromaRefine: a candidate that beat the current match on luma is only taken if it beats it on color as well
+		template<class Model>
+		bool ConfirmCandidate(const cv::Vec2i& target, const cv::Vec2i& ref, const float thDist);
 
 		float CalcSptCost(
 			const cv::Vec2i& target,
@@ -72,16 +190,32 @@ namespace inpainting
 			float w = 0.125f	// 1.0f / 8.0f
 		);
 
-		float CalcAppCost(
+		// combined cost, evaluation stops early once it is clear that maxCost can't be beaten (FLT_MAX is returned then),
+		// the appearance terms compare the luma planes if Luma is set
+		template<class Model, bool Luma = Model::mode != CostMode::Rgb>
+		float CalcCost(
+			const cv::Vec2i& target,
+			const cv::Vec2i& ref,
+			float maxDist,
+			float maxCost = FLT_MAX
+		);
+
+		// appearance cost against the current (mColor) or previous (prevColor) frame
+		template<int WindowSize>
+		float CalcPatchCost(
+			const cv::Mat4b& refColor,
 			const cv::Vec2i& target,
 			const cv::Vec2i& ref,
-			float w = 0.04f		// 1.0f / 25.0f
+			float maxCost
 		);
 
-		float CalcExtAppCost(
+		// the same on the luma planes (mLuma or prevLuma), normalized to the same range
+		template<int WindowSize>
+		float CalcLumaCost(
+			const cv::Mat1b& refLuma,
 			const cv::Vec2i& target,
 			const cv::Vec2i& ref,
-			float w = 0.04f		// 1.0f / 25.0f
+			float maxCost
 		);
 	};
-}
\ No newline at end of file
+}
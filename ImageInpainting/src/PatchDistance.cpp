@@ -0,0 +1,144 @@
+#include "PatchDistance.hpp"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define INPAINTING_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define INPAINTING_TARGET(isa) __attribute__((target(isa)))
+#else
+#define INPAINTING_TARGET(isa)
+#endif
+
+namespace inpainting
+{
+#ifdef INPAINTING_X86
+	static inline __m128i LoadPixel(const uchar* ptr)
+	{
+		int pixel;
+		std::memcpy(&pixel, ptr, sizeof(pixel));
+		return _mm_cvtsi32_si128(pixel);
+	}
+
+	// A patch row is 20 bytes: four pixels in one 16 byte load and the fifth in a 32 bit load,
+	// so nothing behind the patch is read.
+	INPAINTING_TARGET("sse4.1")
+	static int PatchSsd5x5Sse41(const uchar* target, size_t targetStep, const uchar* ref, size_t refStep, int limit)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc = zero;
+		for (int r = 0; r < 5; ++r)
+		{
+			const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(target));
+			const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ref));
+			const __m128i dLo = _mm_sub_epi16(_mm_cvtepu8_epi16(t), _mm_cvtepu8_epi16(p));
+			const __m128i dHi = _mm_sub_epi16(_mm_unpackhi_epi8(t, zero), _mm_unpackhi_epi8(p, zero));
+			const __m128i dLast = _mm_sub_epi16(
+				_mm_cvtepu8_epi16(LoadPixel(target + 16)),
+				_mm_cvtepu8_epi16(LoadPixel(ref + 16)));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(dLo, dLo));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(dHi, dHi));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(dLast, dLast));
+
+			__m128i sum = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+			const int ssd = _mm_cvtsi128_si32(sum);
+			if (ssd > limit || r == 4) return ssd;
+
+			target += targetStep;
+			ref += refStep;
+		}
+		return 0;
+	}
+
+	INPAINTING_TARGET("avx2")
+	static int PatchSsd5x5Avx2(const uchar* target, size_t targetStep, const uchar* ref, size_t refStep, int limit)
+	{
+		__m256i acc = _mm256_setzero_si256();
+		__m128i accLast = _mm_setzero_si128();
+		for (int r = 0; r < 5; ++r)
+		{
+			const __m256i t = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(target)));
+			const __m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ref)));
+			const __m256i d = _mm256_sub_epi16(t, p);
+			const __m128i dLast = _mm_sub_epi16(
+				_mm_cvtepu8_epi16(LoadPixel(target + 16)),
+				_mm_cvtepu8_epi16(LoadPixel(ref + 16)));
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+			accLast = _mm_add_epi32(accLast, _mm_madd_epi16(dLast, dLast));
+
+			__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+			sum = _mm_add_epi32(sum, accLast);
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+			const int ssd = _mm_cvtsi128_si32(sum);
+			if (ssd > limit || r == 4) return ssd;
+
+			target += targetStep;
+			ref += refStep;
+		}
+		return 0;
+	}
+
+	// the 5 pixels of a luma patch row zero extended to 16 bit, read as 4 + 1 bytes so nothing
+	// behind the patch is read (the last rows of a plane have nothing behind them)
+	static inline __m128i LoadLumaRow(const uchar* ptr)
+	{
+		int first;
+		std::memcpy(&first, ptr, sizeof(first));
+		return _mm_unpacklo_epi8(_mm_insert_epi16(_mm_cvtsi32_si128(first), ptr[4], 2), _mm_setzero_si128());
+	}
+
+	INPAINTING_TARGET("sse2")
+	static int PatchSsd5x5LumaSse2(const uchar* target, size_t targetStep, const uchar* ref, size_t refStep, int limit)
+	{
+		__m128i acc = _mm_setzero_si128();
+		for (int r = 0; r < 5; ++r)
+		{
+			const __m128i d = _mm_sub_epi16(LoadLumaRow(target), LoadLumaRow(ref));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(d, d));
+
+			__m128i sum = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+			const int ssd = _mm_cvtsi128_si32(sum);
+			if (ssd > limit || r == 4) return ssd;
+
+			target += targetStep;
+			ref += refStep;
+		}
+		return 0;
+	}
+#endif
+
+	static PatchSsdFunc SelectPatchSsd5x5()
+	{
+#ifdef INPAINTING_X86
+		if (cv::checkHardwareSupport(CV_CPU_AVX2)) return PatchSsd5x5Avx2;
+		if (cv::checkHardwareSupport(CV_CPU_SSE4_1)) return PatchSsd5x5Sse41;
+#endif
+		return PatchSsdScalar<5>;
+	}
+
+	PatchSsdFunc GetPatchSsd5x5()
+	{
+		static const PatchSsdFunc func = SelectPatchSsd5x5();
+		return func;
+	}
+
+	static PatchSsdFunc SelectPatchSsd5x5Luma()
+	{
+#ifdef INPAINTING_X86
+		if (cv::checkHardwareSupport(CV_CPU_SSE2)) return PatchSsd5x5LumaSse2;
+#endif
+		return PatchSsdScalar<5, 1>;
+	}
+
+	PatchSsdFunc GetPatchSsd5x5Luma()
+	{
+		static const PatchSsdFunc func = SelectPatchSsd5x5Luma();
+		return func;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "opencv2/opencv.hpp"
+
+namespace inpainting
+{
+	// Sum of squared differences between two square BGRx patches (8 bit, interleaved, the padding
+	// byte is the same in both images). The pointers address the top left pixel of each patch.
+	// Evaluation stops after the first row whose running sum exceeds limit, the partial sum is
+	// returned then. The scalar version also handles other pixel sizes (1 for a luma plane).
+	typedef int(*PatchSsdFunc)(const uchar* target, size_t targetStep, const uchar* ref, size_t refStep, int limit);
+
+	template<int WindowSize, int Channels = 4>
+	int PatchSsdScalar(const uchar* target, size_t targetStep, const uchar* ref, size_t refStep, int limit)
+	{
+		int ssd = 0;
+		for (int r = 0; r < WindowSize; ++r)
+		{
+			for (int c = 0; c < Channels * WindowSize; ++c)
+			{
+				const int diff = int(target[c]) - int(ref[c]);
+				ssd += diff * diff;
+			}
+			if (ssd > limit) return ssd;
+			target += targetStep;
+			ref += refStep;
+		}
+		return ssd;
+	}
+
+	// Returns the fastest kernel supported by the CPU (AVX2, SSE4.1 or scalar).
+	PatchSsdFunc GetPatchSsd5x5();
+
+	// The same for 5x5 luma patches, one byte per pixel (SSE2 or scalar).
+	PatchSsdFunc GetPatchSsd5x5Luma();
+}
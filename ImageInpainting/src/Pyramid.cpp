@@ -0,0 +1,122 @@
+#include "Pyramid.hpp"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INPAINTING_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace inpainting
+{
+	static void MinPoolRow2x(const uchar* mask0, const uchar* mask1, uchar* dst, int width)
+	{
+		int c = 0;
+#ifdef INPAINTING_SSE2
+		const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+		for (; c + 16 <= width; c += 16)
+		{
+			const __m128i a = _mm_min_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask0 + 2 * c)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask1 + 2 * c)));
+			const __m128i b = _mm_min_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask0 + 2 * c + 16)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask1 + 2 * c + 16)));
+			// the minimum of each horizontal pair ends up in the low byte of its 16 bit lane
+			const __m128i minA = _mm_and_si128(_mm_min_epu8(a, _mm_srli_epi16(a, 8)), lowBytes);
+			const __m128i minB = _mm_and_si128(_mm_min_epu8(b, _mm_srli_epi16(b, 8)), lowBytes);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), _mm_packus_epi16(minA, minB));
+		}
+#endif
+		for (; c < width; ++c)
+		{
+			dst[c] = std::min(std::min(mask0[2 * c], mask0[2 * c + 1]), std::min(mask1[2 * c], mask1[2 * c + 1]));
+		}
+	}
+
+	static void MaxPoolRow2x(const uchar* mask0, const uchar* mask1, uchar* dst, int width)
+	{
+		int c = 0;
+#ifdef INPAINTING_SSE2
+		const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+		for (; c + 16 <= width; c += 16)
+		{
+			const __m128i a = _mm_max_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask0 + 2 * c)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask1 + 2 * c)));
+			const __m128i b = _mm_max_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask0 + 2 * c + 16)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask1 + 2 * c + 16)));
+			const __m128i maxA = _mm_and_si128(_mm_max_epu8(a, _mm_srli_epi16(a, 8)), lowBytes);
+			const __m128i maxB = _mm_and_si128(_mm_max_epu8(b, _mm_srli_epi16(b, 8)), lowBytes);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), _mm_packus_epi16(maxA, maxB));
+		}
+#endif
+		for (; c < width; ++c)
+		{
+			dst[c] = std::max(std::max(mask0[2 * c], mask0[2 * c + 1]), std::max(mask1[2 * c], mask1[2 * c + 1]));
+		}
+	}
+
+	static void AverageRow2x(const uchar* color0, const uchar* color1, uchar* dst, int width)
+	{
+		int c = 0;
+#ifdef INPAINTING_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i two = _mm_set1_epi16(2);
+		for (; c + 4 <= width; c += 4)
+		{
+			// 8 source pixels of both rows give 4 destination pixels
+			const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color0 + 8 * c));
+			const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color0 + 8 * c + 16));
+			const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color1 + 8 * c));
+			const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color1 + 8 * c + 16));
+			// vertical sums, each 16 bit register holds two pixels
+			const __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+			const __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+			const __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+			const __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+			// horizontal sums of the pixel pairs
+			const __m128i h0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+			const __m128i h1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+			const __m128i avg0 = _mm_srli_epi16(_mm_add_epi16(h0, two), 2);
+			const __m128i avg1 = _mm_srli_epi16(_mm_add_epi16(h1, two), 2);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * c), _mm_packus_epi16(avg0, avg1));
+		}
+#endif
+		for (; c < width; ++c)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				const int sum = color0[8 * c + k] + color0[8 * c + 4 + k] + color1[8 * c + k] + color1[8 * c + 4 + k];
+				dst[4 * c + k] = uchar((sum + 2) >> 2);
+			}
+		}
+	}
+
+	void PyrDown2x(const cv::Mat4b& color, const cv::Mat1b& mask, cv::Mat4b& colorDown, cv::Mat1b& maskDown)
+	{
+		assert(color.size() == mask.size());
+
+		const cv::Size size = color.size() / 2;
+		colorDown.create(size);
+		maskDown.create(size);
+
+#pragma omp parallel for schedule(static)
+		for (int r = 0; r < size.height; ++r)
+		{
+			AverageRow2x(color.ptr<uchar>(2 * r), color.ptr<uchar>(2 * r + 1), colorDown.ptr<uchar>(r), size.width);
+			MinPoolRow2x(mask.ptr<uchar>(2 * r), mask.ptr<uchar>(2 * r + 1), maskDown.ptr<uchar>(r), size.width);
+		}
+	}
+
+	void MaxPool2x(const cv::Mat1b& mask, cv::Mat1b& maskDown)
+	{
+		const cv::Size size = mask.size() / 2;
+		maskDown.create(size);
+
+#pragma omp parallel for schedule(static)
+		for (int r = 0; r < size.height; ++r)
+		{
+			MaxPoolRow2x(mask.ptr<uchar>(2 * r), mask.ptr<uchar>(2 * r + 1), maskDown.ptr<uchar>(r), size.width);
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "opencv2/opencv.hpp"
+
+namespace inpainting
+{
+	// Builds the next coarser level in a single pass: every 2x2 block of the color is averaged and
+	// the mask is min-pooled, so a pixel of the coarser level is only known if all four pixels were.
+	// The color is BGRx. The outputs have half the size (rounded down) and are only reallocated if
+	// that changes.
+	void PyrDown2x(const cv::Mat4b& color, const cv::Mat1b& mask, cv::Mat4b& colorDown, cv::Mat1b& maskDown);
+
+	// Max-pools every 2x2 block, a pixel of the coarser level is set if any of the four was.
+	void MaxPool2x(const cv::Mat1b& mask, cv::Mat1b& maskDown);
+}
@@ -0,0 +1,63 @@
+#include "..\include\TemporalCopyInpainter.hpp"
+#include "..\include\FastInpainter.hpp"
+
+namespace inpainting {
+
+	TemporalCopyInpainter::TemporalCopyInpainter() { }
+	TemporalCopyInpainter::~TemporalCopyInpainter() { }
+
+	void TemporalCopyInpainter::Init(InpaintingParams& parameters) {
+		params = parameters;
+		plate.release();
+		seen.release();
+	}
+
+	void TemporalCopyInpainter::Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted)
+	{
+		assert(color.size() == mask.size());
+		assert(color.type() == CV_8UC3);
+		assert(mask.type() == CV_8U);
+
+		color.copyTo(inpainted);
+		const cv::Mat src = color.getMat();
+		const cv::Mat msk = mask.getMat();
+		cv::Mat out = inpainted.getMat();
+
+		if (plate.size() != src.size())
+		{
+			plate.create(src.size());
+			seen.create(src.size());
+			seen.setTo(0);
+		}
+		unseenMask.create(src.size());
+
+		// known pixels update the plate, holes are taken from it
+		bool anyUnseen = false;
+		for (int r = 0; r < src.rows; ++r)
+		{
+			auto ptrColor = src.ptr<cv::Vec3b>(r);
+			auto ptrMask = msk.ptr<uchar>(r);
+			auto ptrOut = out.ptr<cv::Vec3b>(r);
+			auto ptrPlate = plate.ptr<cv::Vec3b>(r);
+			auto ptrSeen = seen.ptr<uchar>(r);
+			auto ptrUnseen = unseenMask.ptr<uchar>(r);
+			for (int c = 0; c < src.cols; ++c)
+			{
+				ptrUnseen[c] = 0;
+				if (ptrMask[c] != 0)
+				{
+					ptrPlate[c] = ptrColor[c];
+					ptrSeen[c] = 255;
+				}
+				else if (ptrSeen[c] != 0) ptrOut[c] = ptrPlate[c];
+				else
+				{
+					ptrUnseen[c] = 255;
+					anyUnseen = true;
+				}
+			}
+		}
+
+		if (anyUnseen) FastInpainter::FillHoles(out, unseenMask, params.fastInpaintRadius, cv::INPAINT_TELEA);
+	}
+}
@@ -1,4 +1,9 @@
 #include "../include/VideoInpainter.hpp"
+#include "Pyramid.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
 
 
 namespace inpainting {
@@ -8,6 +13,14 @@ namespace inpainting {
 
 	void VideoInpainter::Init(InpaintingParams& parameters) {
 		ImageInpainter::Init(parameters);
+		// the plate is registered with the estimated camera motion, without it the plate would drift
+		if (!params.motionCompensation) params.backgroundPlate = false;
+		// the temporal state belongs to the whole region, so video is never tiled
+		if (params.tileMemoryBudget != 0)
+		{
+			std::cout << "[WARNING]: tileMemoryBudget only applies to single images, video regions aren't tiled" << std::endl;
+			params.tileMemoryBudget = 0;
+		}
 	}
 
 	void VideoInpainter::Inpaint(cv::InputArray color, cv::InputArray mask, cv::OutputArray inpainted)
@@ -16,54 +29,498 @@ namespace inpainting {
 		assert(color.type() == CV_8UC3);
 		assert(mask.type() == CV_8U);
 
-		if (initializedSize != color.size()) {
-			Initialize(color, mask);
+		color.copyTo(inpainted);
+		if (params.splitComponents)
+		{
+			cv::Mat out = inpainted.getMat();
+			InpaintComponents(color.getMat(), mask.getMat(), out);
+			return;
+		}
+
+		const cv::Rect holes = CalcHoleRect(mask.getMat());
+		if (holes.empty()) return;
+		const cv::Rect roi = SelectRoi(holes, color.size());
+
+		cv::Mat dst = inpainted.getMat()(roi);
+		InpaintRoi(color.getMat()(roi), mask.getMat()(roi), roi, dst);
+	}
+
+	void VideoInpainter::InpaintRoi(const cv::Mat & colorRoi, const cv::Mat & maskRoi, const cv::Rect & roi, cv::Mat & dst, const cv::Mat1b & exclude)
+	{
+		if (initializedRoi != roi) {
+			Initialize(colorRoi, maskRoi);
+			initializedRoi = roi;
+		}
+		else if (params.resultCache && IsCachedResult(colorRoi, maskRoi, exclude))
+		{
+			// the levels still hold the last result, the frame still counts for the plate
+			if (params.backgroundPlate && hasPlate) AgePlate(maskRoi, exclude);
+			BlendBorder(dst);
+			return;
+		}
+
+		LoadFrame(colorRoi, maskRoi, exclude);
+
+		RunLevels(int(numActiveLevels));
+
+		BlendBorder(dst);
+
+		if (params.resultCache)
+		{
+			colorRoi.copyTo(cachedColor);
+			maskRoi.copyTo(cachedMask);
+			exclude.copyTo(cachedExclude);
+			hasCachedResult = true;
+		}
+	}
+
+	// The last result can be reused if the mask is exactly the same and the known pixels around it
+	// differ by no more than cacheSadThresh on average from the frame it was computed for. The average
+	// is taken per block of 16x16 pixels and the largest one counts, so a local change next to a hole
+	// isn't averaged away by the rest of the region.
+	bool VideoInpainter::IsCachedResult(const cv::Mat & colorRoi, const cv::Mat & maskRoi, const cv::Mat1b & exclude)
+	{
+		if (!hasCachedResult) return false;
+
+		for (int r = 0; r < maskRoi.rows; ++r)
+		{
+			if (std::memcmp(maskRoi.ptr<uchar>(r), cachedMask.ptr<uchar>(r), maskRoi.cols) != 0) return false;
+		}
+		if (exclude.empty() != cachedExclude.empty()) return false;
+		for (int r = 0; r < exclude.rows; ++r)
+		{
+			if (std::memcmp(exclude.ptr<uchar>(r), cachedExclude.ptr<uchar>(r), exclude.cols) != 0) return false;
+		}
+
+		const int blockSize = 16;
+		int numKnown = 0;
+		for (int by = 0; by < maskRoi.rows; by += blockSize)
+		{
+			for (int bx = 0; bx < maskRoi.cols; bx += blockSize)
+			{
+				int blockSad = 0, blockKnown = 0;
+				for (int r = by; r < std::min(by + blockSize, maskRoi.rows); ++r)
+				{
+					auto ptrMask = maskRoi.ptr<uchar>(r);
+					auto ptrExclude = exclude.empty() ? nullptr : exclude.ptr<uchar>(r);
+					auto ptrColor = colorRoi.ptr<uchar>(r);
+					auto ptrCached = cachedColor.ptr<uchar>(r);
+					for (int c = bx; c < std::min(bx + blockSize, maskRoi.cols); ++c)
+					{
+						// holes of other groups hold no observed color
+						if (ptrMask[c] == 0 || (ptrExclude && ptrExclude[c] != 0)) continue;
+						blockKnown++;
+						for (int k = 3 * c; k < 3 * c + 3; ++k) blockSad += std::abs(int(ptrColor[k]) - int(ptrCached[k]));
+					}
+				}
+				if (blockSad > params.cacheSadThresh * 3.0f * blockKnown) return false;
+				numKnown += blockKnown;
+			}
 		}
+		return numKnown > 0;
+	}
 
-		LoadFrame(color, mask);
+	// Inpaints a range of the tracks, cv::parallel_for_ over a lambda would allocate the closure
+	// of its std::function every frame.
+	class VideoInpainter::TracksBody : public cv::ParallelLoopBody
+	{
+	public:
+		TracksBody(VideoInpainter& owner, const cv::Mat& color, const cv::Mat& mask, cv::Mat& inpainted)
+			: owner(owner), color(color), mask(mask), inpainted(inpainted) { }
+
+		void operator()(const cv::Range& range) const override
+		{
+			for (int t = range.start; t < range.end; ++t) owner.InpaintTrack(t, color, mask, inpainted);
+		}
+
+	private:
+		VideoInpainter& owner;
+		const cv::Mat& color;
+		const cv::Mat& mask;
+		cv::Mat& inpainted;
+	};
+
+	void VideoInpainter::InpaintComponents(const cv::Mat & color, const cv::Mat & mask, cv::Mat & inpainted)
+	{
+		// connected holes whose context regions overlap are merged into one group (all lists are
+		// members, they only grow with the number of holes)
+		const int numLabels = LabelHoles(mask);
+		groupOf.resize(numLabels);
+		groupHoles.resize(numLabels);
+		for (int i = 1; i < numLabels; ++i)
+		{
+			groupOf[i] = i;
+			groupHoles[i] = ccBoxes[i];
+		}
 
-		for (int i = int(levels.size()) - 1; i >= 0; --i)
+		bool merged = true;
+		while (merged)
 		{
-			levels[i].Run();
-			if (i > 0) FillInLowerLv(levels[i], levels[i - 1]);
+			merged = false;
+			for (int a = 1; a < numLabels && !merged; ++a)
+			{
+				if (groupOf[a] != a) continue;
+				for (int b = a + 1; b < numLabels && !merged; ++b)
+				{
+					if (groupOf[b] != b) continue;
+					// the blending bands of separate groups must not touch even for a small margin
+					const int mergeMargin = std::max(params.contextMargin, params.blurSize);
+					const cv::Rect overlap = CalcRoi(groupHoles[a], color.size(), mergeMargin) & CalcRoi(groupHoles[b], color.size(), mergeMargin);
+					if (overlap.empty()) continue;
+					groupHoles[a] |= groupHoles[b];
+					for (auto& group : groupOf) if (group == b) group = a;
+					merged = true;
+				}
+			}
 		}
 
-		BlendBorder(inpainted);
+		// every group continues the track it overlaps most, together with its buffers, the others
+		// start a new one
+		prevTracks.swap(tracks);
+		tracks.clear();
+		trackLabels.clear();
+		for (int i = 1; i < numLabels; ++i)
+		{
+			if (groupOf[i] != i) continue;
+			const cv::Rect region = CalcRoi(groupHoles[i], color.size(), params.contextMargin);
+			int best = -1, bestArea = 0;
+			for (int t = 0; t < int(prevTracks.size()); ++t)
+			{
+				if (!prevTracks[t].inpainter) continue;
+				const int area = (CalcRoi(prevTracks[t].holes, color.size(), params.contextMargin) & region).area();
+				if (area > bestArea) { best = t; bestArea = area; }
+			}
+
+			ComponentTrack track;
+			if (best >= 0) track = std::move(prevTracks[best]);
+			else
+			{
+				InpaintingParams trackParams = params;
+				trackParams.splitComponents = false;
+				track.inpainter.reset(new VideoInpainter());
+				track.inpainter->Init(trackParams);
+			}
+			track.holes = groupHoles[i];
+			tracks.push_back(std::move(track));
+			trackLabels.push_back(i);
+		}
+		prevTracks.clear();
+
+		// The groups only read and write the pixels of their own holes and blending band (BlendRow
+		// leaves alpha 255 alone, even inside a 16 pixel run shared with a neighbour), and those never
+		// overlap, so they can run concurrently on the same output (which mustn't share memory with
+		// the input).
+		cv::parallel_for_(cv::Range(0, int(tracks.size())), TracksBody(*this, color, mask, inpainted));
+	}
+
+	void VideoInpainter::InpaintTrack(int t, const cv::Mat & color, const cv::Mat & mask, cv::Mat & inpainted)
+	{
+		ComponentTrack& track = tracks[t];
+		const cv::Rect roi = track.inpainter->SelectRoi(track.holes, color.size());
+
+		// holes of other groups inside the region aren't filled by this group, but their color
+		// isn't known either, so they are excluded as sources
+		mask(roi).copyTo(track.mask);
+		track.exclude.create(roi.size());
+		track.hasExclude = false;
+		for (int r = 0; r < roi.height; ++r)
+		{
+			auto ptrMask = track.mask.ptr<uchar>(r);
+			auto ptrExclude = track.exclude.ptr<uchar>(r);
+			auto ptrLabel = ccLabels.ptr<int>(roi.y + r) + roi.x;
+			for (int c = 0; c < roi.width; ++c)
+			{
+				ptrExclude[c] = 0;
+				if (ptrMask[c] != 0 || groupOf[ptrLabel[c]] == trackLabels[t]) continue;
+				ptrMask[c] = 255;
+				ptrExclude[c] = 255;
+				track.hasExclude = true;
+			}
+		}
+
+		cv::Mat dst = inpainted(roi);
+		track.inpainter->InpaintRoi(color(roi), track.mask, roi, dst, track.hasExclude ? track.exclude : cv::Mat1b());
+	}
+
+	cv::Rect VideoInpainter::SelectRoi(const cv::Rect & holes, const cv::Size & frameSize)
+	{
+		const cv::Rect needed = CalcRoi(holes, frameSize, params.contextMargin);
+		if (params.contextMargin < 0) return needed;
+
+		// the temporal state only stays valid while the region doesn't move, so keep the current one
+		// as long as it holds the holes with their context and isn't much larger than required
+		if ((needed & initializedRoi) == needed && initializedRoi.area() <= 2 * needed.area()) return initializedRoi;
+
+		// leave some slack so that slowly moving holes don't force a new region every frame
+		return CalcRoi(holes, frameSize, params.contextMargin + params.contextMargin / 2);
 	}
 
 	void VideoInpainter::Initialize(cv::InputArray color, cv::InputArray mask)
 	{
 		// build pyramid
-		initializedSize = color.size();
-		levels.resize(CalcNumberOfLevels(color));
+		levels.resize(CalcNumberOfLevels(color, -1));
+		numActiveLevels = 0;
+		lvColors.resize(levels.size());
+		lvMasks.resize(levels.size());
+		lvExcludes.resize(levels.size());
 		auto size = color.size();
 
 		for (size_t i = 0; i < levels.size(); ++i)
 		{
-			levels[i].Init(size, params);
+			levels[i].Init(size, LevelParams(i));
+			lvColors[i].create(size);
+			lvMasks[i].create(size);
 			size /= 2;
 		}
+
+		mAlpha.create(color.size());
+
+		// motion is estimated on thumbnails of at most 256 pixels per side
+		thumbScale = 1;
+		while (std::max(color.cols(), color.rows()) / thumbScale > 256) thumbScale *= 2;
+		const cv::Size thumbSize(std::max(color.cols() / thumbScale, 1), std::max(color.rows() / thumbScale, 1));
+		thumb.create(thumbSize);
+		prevThumb.create(thumbSize);
+		cv::createHanningWindow(thumbWindow, thumbSize, CV_32F);
+		hasPrevThumb = false;
+		motionRemainder = cv::Point2d(0.0, 0.0);
+		hasCachedResult = false;
+		hasPlate = false;
 	}
 
-	void VideoInpainter::LoadFrame(cv::InputArray color, cv::InputArray mask)
+	void VideoInpainter::LoadFrame(cv::InputArray color, cv::InputArray mask, const cv::Mat1b & exclude)
 	{
-		levels[0].LoadFrame(color.getMat(), mask.getMat());
+		cv::Vec2i motion;
+		const bool continuous = EstimateMotion(color.getMat(), motion);
+		if (!continuous)
+		{
+			for (auto& level : levels) level.ResetTemporal();
+		}
 
-		for (size_t i = 1; i < levels.size(); ++i)
+		// holes the plate has seen recently are known pixels for the levels, the blending still
+		// follows the original mask
+		cv::Mat levelColor = color.getMat();
+		cv::Mat levelMask = mask.getMat();
+		if (params.backgroundPlate)
 		{
-			auto size = levels[i - 1].GetColorPtr()->size() / 2;
+			UpdatePlate(levelColor, levelMask, exclude, motion, continuous);
+			levelColor = plateColor;
+			levelMask = plateMask;
+		}
+
+		// the depth follows the hole size, levels that were skipped last frame have no usable temporal state
+		const size_t numLevels = std::min(size_t(CalcNumberOfLevels(levelColor, CalcMaxHoleExtent(levelMask))), levels.size());
+		for (size_t i = numActiveLevels; i < numLevels; ++i) levels[i].ResetTemporal();
+		numActiveLevels = numLevels;
 
-			// color
-			cv::Mat3b tmpColor;
-			cv::resize(*(levels[i - 1].GetColorPtr()), tmpColor, size, 0.0, 0.0, cv::INTER_LINEAR);
-			// mask
-			cv::Mat1b tmpMask;
-			cv::resize(*(levels[i - 1].GetMaskPtr()), tmpMask, size, 0.0, 0.0, cv::INTER_LINEAR);
+		levels[0].LoadFrame(levelColor, levelMask, motion, exclude);
+
+		for (size_t i = 1; i < numActiveLevels; ++i)
+		{
+			PyrDown2x(*(levels[i - 1].GetColorPtr()), *(levels[i - 1].GetMaskPtr()), lvColors[i], lvMasks[i]);
+			if (!exclude.empty()) MaxPool2x(i == 1 ? exclude : lvExcludes[i - 1], lvExcludes[i]);
+			const double scale = 1.0 / double(1 << i);
+			levels[i].LoadFrame(lvColors[i], lvMasks[i], cv::Vec2i(cvRound(motion[0] * scale), cvRound(motion[1] * scale)),
+				exclude.empty() ? cv::Mat1b() : lvExcludes[i]);
+		}
 
-			levels[i].LoadFrame(tmpColor, tmpMask);
+		BlurMask(mask.getMat());
+	}
+
+	// The plate holds the last color seen at every pixel of the region and how many frames ago that
+	// was. It moves with the estimated camera motion and starts over at a scene cut. Hole pixels seen
+	// within plateMaxAge frames are taken from it, PatchMatch only synthesizes the others. Excluded
+	// pixels are hidden as well and don't count as seen.
+	void VideoInpainter::UpdatePlate(const cv::Mat & color, const cv::Mat & mask, const cv::Mat1b & exclude, const cv::Vec2i & motion, bool continuous)
+	{
+		if (!hasPlate || !continuous)
+		{
+			color.copyTo(plate);
+			plateAge.create(color.size());
+			plateAge.setTo(255);
+			hasPlate = true;
+		}
+		else if (motion != cv::Vec2i(0, 0))
+		{
+			// content at p was at p - motion in the previous frame, uncovered pixels were never seen
+			const cv::Point shift(motion[1], motion[0]);
+			const cv::Rect frame(cv::Point(0, 0), color.size());
+			const cv::Rect moved = frame & (frame + shift);
+			plateTmp.create(color.size());
+			plateAgeTmp.create(color.size());
+			plateAgeTmp.setTo(255);
+			if (!moved.empty())
+			{
+				plate(moved - shift).copyTo(plateTmp(moved));
+				plateAge(moved - shift).copyTo(plateAgeTmp(moved));
+			}
+			std::swap(plate, plateTmp);
+			std::swap(plateAge, plateAgeTmp);
+		}
+
+		color.copyTo(plateColor);
+		mask.copyTo(plateMask);
+		const int maxAge = std::min(std::max(params.plateMaxAge, 0), 254);
+		CheckPlate(color, mask, exclude, maxAge);
+
+#pragma omp parallel for schedule(static)
+		for (int r = 0; r < color.rows; ++r)
+		{
+			auto ptrColor = color.ptr<cv::Vec3b>(r);
+			auto ptrMask = mask.ptr<uchar>(r);
+			auto ptrPlate = plate.ptr<cv::Vec3b>(r);
+			auto ptrAge = plateAge.ptr<uchar>(r);
+			auto ptrPlateColor = plateColor.ptr<cv::Vec3b>(r);
+			auto ptrPlateMask = plateMask.ptr<uchar>(r);
+			auto ptrExclude = exclude.empty() ? nullptr : exclude.ptr<uchar>(r);
+			for (int c = 0; c < color.cols; ++c)
+			{
+				if (ptrExclude && ptrExclude[c] != 0)
+				{
+					if (ptrAge[c] < 255) ptrAge[c]++;
+					continue;
+				}
+				if (ptrMask[c] != 0)
+				{
+					ptrPlate[c] = ptrColor[c];
+					ptrAge[c] = 0;
+					continue;
+				}
+				if (ptrAge[c] < 255) ptrAge[c]++;
+				if (plateBlockTrusted[(r / plateBlockSize) * plateBlocksX + c / plateBlockSize] == 0) ptrAge[c] = 255;
+				if (ptrAge[c] <= maxAge)
+				{
+					ptrPlateColor[c] = ptrPlate[c];
+					ptrPlateMask[c] = 255;
+				}
+			}
+		}
+	}
+
+	// The motion only registers the plate to whole pixels of the region, and the scene can change
+	// behind the holes' surroundings. Before the plate is updated, the known pixels of every block of
+	// plateBlockSize pixels are compared with the plate pixels seen within maxAge frames. Blocks whose
+	// mean difference exceeds plateMismatchThresh don't fill their holes from the plate, blocks
+	// without such pixels follow the whole region.
+	void VideoInpainter::CheckPlate(const cv::Mat & color, const cv::Mat & mask, const cv::Mat1b & exclude, int maxAge)
+	{
+		plateBlocksX = (color.cols + plateBlockSize - 1) / plateBlockSize;
+		const int blocksY = (color.rows + plateBlockSize - 1) / plateBlockSize;
+		plateBlockSad.resize(plateBlocksX * blocksY);
+		plateBlockCount.resize(plateBlocksX * blocksY);
+		plateBlockTrusted.resize(plateBlocksX * blocksY);
+
+		long long totalSad = 0, totalCount = 0;
+#pragma omp parallel for schedule(static) reduction(+:totalSad, totalCount)
+		for (int by = 0; by < blocksY; ++by)
+		{
+			std::fill_n(plateBlockSad.begin() + by * plateBlocksX, plateBlocksX, 0);
+			std::fill_n(plateBlockCount.begin() + by * plateBlocksX, plateBlocksX, 0);
+			for (int r = by * plateBlockSize; r < std::min((by + 1) * plateBlockSize, color.rows); ++r)
+			{
+				auto ptrColor = color.ptr<uchar>(r);
+				auto ptrMask = mask.ptr<uchar>(r);
+				auto ptrExclude = exclude.empty() ? nullptr : exclude.ptr<uchar>(r);
+				auto ptrPlate = plate.ptr<uchar>(r);
+				auto ptrAge = plateAge.ptr<uchar>(r);
+				for (int c = 0; c < color.cols; ++c)
+				{
+					if (ptrMask[c] == 0 || (ptrExclude && ptrExclude[c] != 0) || ptrAge[c] > maxAge) continue;
+					const int block = by * plateBlocksX + c / plateBlockSize;
+					for (int k = 3 * c; k < 3 * c + 3; ++k) plateBlockSad[block] += std::abs(int(ptrColor[k]) - int(ptrPlate[k]));
+					plateBlockCount[block]++;
+				}
+			}
+			for (int block = by * plateBlocksX; block < (by + 1) * plateBlocksX; ++block)
+			{
+				totalSad += plateBlockSad[block];
+				totalCount += plateBlockCount[block];
+			}
+		}
+
+		const double thresh = 3.0 * params.plateMismatchThresh;
+		const bool regionTrusted = totalSad <= thresh * totalCount;
+		for (size_t block = 0; block < plateBlockTrusted.size(); ++block)
+		{
+			const bool trusted = plateBlockCount[block] > 0 ? plateBlockSad[block] <= thresh * plateBlockCount[block] : regionTrusted;
+			plateBlockTrusted[block] = trusted ? 255 : 0;
+		}
+	}
+
+	// A frame answered from the result cache isn't loaded, its holes still stay unseen for one more frame.
+	void VideoInpainter::AgePlate(const cv::Mat & mask, const cv::Mat1b & exclude)
+	{
+		for (int r = 0; r < mask.rows; ++r)
+		{
+			auto ptrMask = mask.ptr<uchar>(r);
+			auto ptrExclude = exclude.empty() ? nullptr : exclude.ptr<uchar>(r);
+			auto ptrAge = plateAge.ptr<uchar>(r);
+			for (int c = 0; c < mask.cols; ++c)
+			{
+				const bool hidden = ptrMask[c] == 0 || (ptrExclude && ptrExclude[c] != 0);
+				if (hidden && ptrAge[c] < 255) ptrAge[c]++;
+			}
+		}
+	}
+
+	// Global translation (rows, cols) of the content since the previous frame in pixels of the finest
+	// level, from sub-pixel phase correlation of gray thumbnails. Returns false at a scene cut, i.e. if the
+	// frames still differ by more than sceneCutThresh on average after compensating the motion. Without
+	// motionCompensation nothing is estimated: unaligned thumbnails of a pan would look like a cut.
+	bool VideoInpainter::EstimateMotion(const cv::Mat & color, cv::Vec2i & motion)
+	{
+		motion = cv::Vec2i(0, 0);
+		if (!params.motionCompensation) return true;
+
+		// gray means of thumbScale x thumbScale blocks, like an INTER_AREA resize and the gray
+		// conversion but without their temporary buffers
+		std::swap(thumb, prevThumb);
+		for (int r = 0; r < thumb.rows; ++r)
+		{
+			const int rowEnd = std::min((r + 1) * thumbScale, color.rows);
+			auto ptrThumb = thumb.ptr<float>(r);
+			for (int c = 0; c < thumb.cols; ++c)
+			{
+				const int colEnd = std::min((c + 1) * thumbScale, color.cols);
+				int sum[3] = { 0, 0, 0 };
+				for (int y = r * thumbScale; y < rowEnd; ++y)
+				{
+					auto ptrColor = color.ptr<uchar>(y);
+					for (int x = c * thumbScale; x < colEnd; ++x)
+					{
+						for (int k = 0; k < 3; ++k) sum[k] += ptrColor[3 * x + k];
+					}
+				}
+				const float area = float((rowEnd - r * thumbScale) * (colEnd - c * thumbScale));
+				ptrThumb[c] = (0.114f * sum[0] + 0.587f * sum[1] + 0.299f * sum[2]) / area;
+			}
+		}
+		if (!hasPrevThumb)
+		{
+			hasPrevThumb = true;
+			return true;
+		}
+
+		// the only per-frame allocations of the video path: phaseCorrelate sets up its DFT buffers
+		// on every call
+		const cv::Point2d shiftF = cv::phaseCorrelate(prevThumb, thumb, thumbWindow);
+		const cv::Point shift(cvRound(shiftF.x), cvRound(shiftF.y));
+
+		const cv::Rect frame(cv::Point(0, 0), thumb.size());
+		const cv::Rect overlap = frame & (frame + shift);
+		const double diff = overlap.empty() ? DBL_MAX : cv::norm(thumb(overlap), prevThumb(overlap - shift), cv::NORM_L1) / overlap.area();
+		if (diff > params.sceneCutThresh)
+		{
+			motionRemainder = cv::Point2d(0.0, 0.0);
+			return false;
 		}
 
-		mColor = color.getMat().clone();
-		cv::blur(mask, mAlpha, cv::Size(params.blurSize, params.blurSize));
+		// the motion is applied in whole pixels of the region, the sub-pixel rest is carried over so
+		// that a slow pan still moves the state once it adds up to a pixel
+		const cv::Point2d total = shiftF * double(thumbScale) + motionRemainder;
+		const cv::Point moved(cvRound(total.x), cvRound(total.y));
+		motionRemainder = total - cv::Point2d(moved);
+		motion = cv::Vec2i(moved.y, moved.x);
+		return true;
 	}
 }
\ No newline at end of file
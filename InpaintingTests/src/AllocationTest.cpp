@@ -0,0 +1,144 @@
+#include "AllocationTest.hpp"
+#include "VideoInpainter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+// Heap allocations of the test and the statically linked inpainting library go through this global
+// operator new, which counts them while enabled. Allocations inside the OpenCV DLL don't, its cv::Mat
+// buffers are counted by CountingAllocator instead.
+static std::atomic<bool> countHeap(false);
+static std::atomic<int> heapAllocations(0);
+
+void* operator new(std::size_t size)
+{
+	if (countHeap) heapAllocations++;
+	if (void* ptr = std::malloc(size != 0 ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+namespace inpainting_tests
+{
+	// Counts the buffers cv::Mat allocates, the memory itself comes from the standard allocator.
+	class CountingAllocator : public cv::MatAllocator
+	{
+	public:
+		CountingAllocator() : count(0) { }
+
+		cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+		{
+			count++;
+			return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+		}
+
+		bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override
+		{
+			return cv::Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+		}
+
+		void deallocate(cv::UMatData* data) const override
+		{
+			cv::Mat::getStdAllocator()->deallocate(data);
+		}
+
+		mutable std::atomic<int> count;
+	};
+
+	static const cv::Size frameSize(640, 360);
+	static const int numWarmUpFrames = 2;	// the first frame allocates the region, the second its temporal state
+	static const int numFrames = 12;
+
+	// textured background that pans by one pixel per frame, with a hole moving along
+	static void MakeFrame(const cv::Mat3b& scene, int frame, cv::Mat3b& color, cv::Mat1b& mask)
+	{
+		scene(cv::Rect(cv::Point(frame, 0), frameSize)).copyTo(color);
+		mask.setTo(255);
+		mask(cv::Rect(300 + frame, 150, 40, 60)).setTo(0);
+	}
+
+	static int CountAllocations(inpainting::InpaintingParams params, const cv::Mat3b& scene)
+	{
+		inpainting::VideoInpainter inpainter;
+		inpainter.Init(params);
+
+		cv::Mat3b color(frameSize), inpainted(frameSize);
+		cv::Mat1b mask(frameSize);
+		for (int i = 0; i < numWarmUpFrames; ++i)
+		{
+			MakeFrame(scene, i, color, mask);
+			inpainter.Inpaint(color, mask, inpainted);
+		}
+
+		CountingAllocator counter;
+		cv::MatAllocator* defaultAllocator = cv::Mat::getDefaultAllocator();
+		cv::Mat::setDefaultAllocator(&counter);
+		heapAllocations = 0;
+		countHeap = true;
+		for (int i = numWarmUpFrames; i < numFrames; ++i)
+		{
+			MakeFrame(scene, i, color, mask);
+			inpainter.Inpaint(color, mask, inpainted);
+		}
+		countHeap = false;
+		cv::Mat::setDefaultAllocator(defaultAllocator);
+
+		return counter.count + heapAllocations;
+	}
+
+	static bool Check(const std::string& name, int allocations, bool expectNone)
+	{
+		const int numCounted = numFrames - numWarmUpFrames;
+		const bool passed = !expectNone || allocations == 0;
+		std::cout << (passed ? "[PASS] " : "[FAIL] ") << "allocations, " << name << ": " << allocations
+			<< " in " << numCounted << " frames" << (expectNone ? "" : " (documented, not checked)") << std::endl;
+		return passed;
+	}
+
+	bool RunAllocationTest()
+	{
+		cv::Mat3b scene(frameSize.height, frameSize.width + numFrames);
+		cv::theRNG().state = 1;
+		cv::randu(scene, cv::Scalar::all(0), cv::Scalar::all(255));
+		cv::GaussianBlur(scene, scene, cv::Size(5, 5), 0.0);
+
+		inpainting::InpaintingParams params;
+		params.seed = 1;
+		params.contextMargin = 64;
+		params.motionCompensation = false;
+
+		bool passed = Check("region", CountAllocations(params, scene), true);
+
+		inpainting::InpaintingParams incremental = params;
+		incremental.incremental = true;
+		passed &= Check("incremental", CountAllocations(incremental, scene), true);
+
+		inpainting::InpaintingParams split = params;
+		split.splitComponents = true;
+		passed &= Check("split components", CountAllocations(split, scene), true);
+
+		// phaseCorrelate allocates its DFT buffers on every call
+		inpainting::InpaintingParams motion = params;
+		motion.motionCompensation = true;
+		Check("motion compensation", CountAllocations(motion, scene), false);
+
+		return passed;
+	}
+}
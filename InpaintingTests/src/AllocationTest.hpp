@@ -0,0 +1,9 @@
+#pragma once
+
+namespace inpainting_tests
+{
+	// Runs VideoInpainter over a synthetic pan and counts the cv::Mat buffers and the other heap
+	// allocations per frame once the buffers of the region exist. Configurations that are expected to be allocation-free fail
+	// the test if they allocate, the documented exceptions are only reported.
+	bool RunAllocationTest();
+}
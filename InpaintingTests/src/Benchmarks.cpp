@@ -0,0 +1,314 @@
+#include "Benchmarks.hpp"
+#include "ImageInpainter.hpp"
+#include "InpaintingEngine.hpp"
+#include "InpaintingLevel.hpp"
+#include "PatchDistance.hpp"
+
+#include <climits>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace inpainting_tests
+{
+	static const cv::Size frameSize(640, 360);
+	static const int numFrames = 20;
+
+	static double Seconds(int64 ticks)
+	{
+		return double(ticks) / cv::getTickFrequency();
+	}
+
+	// the still images of mediaDir scaled to size, the ground truth of every frame
+	static std::vector<cv::Mat3b> LoadScenes(const std::string& mediaDir, const cv::Size& size = frameSize)
+	{
+		std::vector<std::string> files;
+		cv::glob(mediaDir + "/*.jpg", files);
+		std::vector<cv::Mat3b> scenes;
+		for (const auto& file : files)
+		{
+			const cv::Mat image = cv::imread(file);
+			if (image.empty()) continue;
+			cv::Mat3b scene;
+			cv::resize(image, scene, size, 0.0, 0.0, cv::INTER_AREA);
+			scenes.push_back(scene);
+		}
+		if (scenes.empty()) std::cout << "no images found in " << mediaDir << std::endl;
+		return scenes;
+	}
+
+	// a 60x80 hole that moves right by 2 pixels per frame
+	static void MakeHole(int frame, cv::Mat1b& mask)
+	{
+		mask.create(frameSize);
+		mask.setTo(255);
+		mask(cv::Rect(280 + 2 * frame, 140, 60, 80)).setTo(0);
+	}
+
+	// PSNR of the inpainted pixels against the ground truth
+	static double HolePsnr(const cv::Mat3b& truth, const cv::Mat3b& result, const cv::Mat1b& mask)
+	{
+		double sse = 0.0;
+		int count = 0;
+		for (int r = 0; r < mask.rows; ++r)
+		{
+			for (int c = 0; c < mask.cols; ++c)
+			{
+				if (mask(r, c) != 0) continue;
+				for (int k = 0; k < 3; ++k)
+				{
+					const double diff = double(truth(r, c)[k]) - double(result(r, c)[k]);
+					sse += diff * diff;
+				}
+				count += 3;
+			}
+		}
+		if (sse == 0.0) return 99.0;
+		return 10.0 * std::log10(255.0 * 255.0 * count / sse);
+	}
+
+	struct EngineResult
+	{
+		double msPerFrame = 0.0;	// mean over all frames but the first (setup)
+		double psnr = 0.0;			// mean over all frames
+	};
+
+	static EngineResult RunEngine(inpainting::EngineType type, inpainting::InpaintingParams params, const cv::Mat3b& scene)
+	{
+		std::unique_ptr<inpainting::InpaintingEngine> engine = inpainting::CreateEngine(type);
+		engine->Init(params);
+
+		EngineResult result;
+		cv::Mat1b mask;
+		cv::Mat3b inpainted;
+		double seconds = 0.0;
+		for (int i = 0; i < numFrames; ++i)
+		{
+			MakeHole(i, mask);
+			const int64 start = cv::getTickCount();
+			engine->Inpaint(scene, mask, inpainted);
+			if (i > 0) seconds += Seconds(cv::getTickCount() - start);
+			result.psnr += HolePsnr(scene, inpainted, mask) / numFrames;
+		}
+		result.msPerFrame = 1000.0 * seconds / (numFrames - 1);
+		return result;
+	}
+
+	template<class Func>
+	static double TimePatchSsd(const cv::Mat& target, const cv::Mat& ref, const std::vector<cv::Vec2i>& positions, Func patchSsd, long long& sum)
+	{
+		const int64 start = cv::getTickCount();
+		for (size_t i = 0; i + 1 < positions.size(); ++i)
+		{
+			const cv::Vec2i& t = positions[i];
+			const cv::Vec2i& p = positions[i + 1];
+			sum += patchSsd(target.ptr<uchar>(t[0]) + t[1] * target.elemSize(), target.step, ref.ptr<uchar>(p[0]) + p[1] * ref.elemSize(), ref.step, INT_MAX);
+		}
+		return Seconds(cv::getTickCount() - start);
+	}
+
+	// Copies the color of a random source to every pixel, as Inpaint() does for the holes.
+	template<typename T>
+	static double TimeGather(cv::Mat_<T>& color, const std::vector<cv::Vec2i>& sources)
+	{
+		const int64 start = cv::getTickCount();
+		size_t i = 0;
+		for (int r = 0; r < color.rows; ++r)
+		{
+			for (int c = 0; c < color.cols; ++c, ++i) color(r, c) = color(sources[i][0], sources[i][1]);
+		}
+		return Seconds(cv::getTickCount() - start);
+	}
+
+	void RunKernelBenchmark()
+	{
+		const cv::Size size(1280, 720);
+		const int numPatches = 4000000;
+		std::minstd_rand rng(1);
+		std::uniform_int_distribution<int> row(0, size.height - 5), col(0, size.width - 5);
+
+		cv::Mat3b bgr(size);
+		cv::theRNG().state = 1;
+		cv::randu(bgr, cv::Scalar::all(0), cv::Scalar::all(255));
+		cv::Mat4b bgrx;
+		cv::cvtColor(bgr, bgrx, cv::COLOR_BGR2BGRA);
+		std::vector<cv::Vec2i> positions(numPatches);
+		for (auto& p : positions) p = cv::Vec2i(row(rng), col(rng));
+
+		long long warmUp = 0, sumSimd = 0, sumScalar = 0, sumBgr = 0;
+		const inpainting::PatchSsdFunc patchSsd = inpainting::GetPatchSsd5x5();
+		TimePatchSsd(bgrx, bgrx, positions, patchSsd, warmUp);
+		const double secondsSimd = TimePatchSsd(bgrx, bgrx, positions, patchSsd, sumSimd);
+		const double secondsScalar = TimePatchSsd(bgrx, bgrx, positions, inpainting::PatchSsdScalar<5, 4>, sumScalar);
+		const double secondsBgr = TimePatchSsd(bgr, bgr, positions, inpainting::PatchSsdScalar<5, 3>, sumBgr);
+
+		cv::Mat1b luma;
+		cv::cvtColor(bgr, luma, cv::COLOR_BGR2GRAY);
+		long long sumLuma = 0, sumLumaScalar = 0;
+		const double secondsLuma = TimePatchSsd(luma, luma, positions, inpainting::GetPatchSsd5x5Luma(), sumLuma);
+		const double secondsLumaScalar = TimePatchSsd(luma, luma, positions, inpainting::PatchSsdScalar<5, 1>, sumLumaScalar);
+
+		// one random source per pixel, the whole level is gathered
+		std::vector<cv::Vec2i> sources(size.area());
+		for (auto& s : sources) s = cv::Vec2i(row(rng), col(rng));
+		const double gatherBgr = TimeGather(bgr, sources);
+		const double gatherBgrx = TimeGather(bgrx, sources);
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "kernels, 1280x720, " << numPatches << " random 5x5 patch pairs:" << std::endl
+			<< "  ssd BGRx dispatched " << secondsSimd * 1e9 / numPatches << " ns, BGRx scalar " << secondsScalar * 1e9 / numPatches
+			<< " ns, BGR scalar " << secondsBgr * 1e9 / numPatches << " ns per patch" << (sumSimd == sumScalar && sumScalar == sumBgr ? "" : " (sums differ)") << std::endl
+			<< "  ssd luma dispatched " << secondsLuma * 1e9 / numPatches << " ns, luma scalar " << secondsLumaScalar * 1e9 / numPatches
+			<< " ns per patch" << (sumLuma == sumLumaScalar ? "" : " (sums differ)") << std::endl
+			<< "  gather BGRx " << gatherBgrx * 1e9 / size.area() << " ns, BGR " << gatherBgr * 1e9 / size.area() << " ns per pixel" << std::endl;
+	}
+
+	// Reads the match of every position and of its four neighbours, as the spatial cost does for a
+	// candidate. Returns the seconds taken, the sum keeps the reads from being optimized away.
+	template<typename T>
+	static double TimeNnfReads(const cv::Mat_<cv::Vec<T, 2>>& nnf, const std::vector<cv::Vec2i>& positions, long long& sum)
+	{
+		const int64 start = cv::getTickCount();
+		for (const auto& p : positions)
+		{
+			const cv::Vec<T, 2>& m = nnf(p[0], p[1]);
+			const cv::Vec<T, 2>& u = nnf(p[0] - 1, p[1]);
+			const cv::Vec<T, 2>& d = nnf(p[0] + 1, p[1]);
+			const cv::Vec<T, 2>& l = nnf(p[0], p[1] - 1);
+			const cv::Vec<T, 2>& r = nnf(p[0], p[1] + 1);
+			sum += m[0] + m[1] + u[0] + u[1] + d[0] + d[1] + l[0] + l[1] + r[0] + r[1];
+		}
+		return Seconds(cv::getTickCount() - start);
+	}
+
+	void RunNnfBenchmark()
+	{
+		const cv::Size size(1280, 720);
+		const int numReads = 4000000;
+		std::minstd_rand rng(1);
+		std::uniform_int_distribution<int> row(1, size.height - 2), col(1, size.width - 2);
+
+		cv::Mat2s nnf16(size);
+		cv::Mat2i nnf32(size);
+		for (int r = 0; r < size.height; ++r)
+		{
+			for (int c = 0; c < size.width; ++c)
+			{
+				const cv::Vec2i match(row(rng), col(rng));
+				nnf16(r, c) = inpainting::ToNnf(match);
+				nnf32(r, c) = match;
+			}
+		}
+		std::vector<cv::Vec2i> positions(numReads);
+		for (auto& p : positions) p = cv::Vec2i(row(rng), col(rng));
+
+		long long warmUp = 0, sum16 = 0, sum32 = 0;
+		TimeNnfReads(nnf16, positions, warmUp);
+		const double seconds16 = TimeNnfReads(nnf16, positions, sum16);
+		const double seconds32 = TimeNnfReads(nnf32, positions, sum32);
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "nnf reads, 1280x720, " << numReads << " random positions with 4 neighbours:" << std::endl
+			<< "  Mat2s " << seconds16 * 1e9 / numReads << " ns, Mat2i " << seconds32 * 1e9 / numReads
+			<< " ns per position, " << seconds32 / seconds16 << "x" << (sum16 == sum32 ? "" : " (different matches read)") << std::endl;
+	}
+
+	void RunEngineBenchmark(const std::string& mediaDir)
+	{
+		const std::vector<cv::Mat3b> scenes = LoadScenes(mediaDir);
+		if (scenes.empty()) return;
+
+		inpainting::InpaintingParams params;
+		params.seed = 1;
+		params.contextMargin = 64;
+
+		const std::pair<inpainting::EngineType, const char*> engines[] = {
+			{ inpainting::EngineType::PatchMatch, "patchmatch" },
+			{ inpainting::EngineType::Telea, "telea" },
+			{ inpainting::EngineType::NavierStokes, "ns" },
+			{ inpainting::EngineType::TemporalCopy, "temporal" }
+		};
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "engines, " << frameSize.width << "x" << frameSize.height << ", 60x80 moving hole, mean of " << scenes.size() << " images:" << std::endl;
+		for (const auto& engine : engines)
+		{
+			EngineResult mean;
+			for (const auto& scene : scenes)
+			{
+				const EngineResult result = RunEngine(engine.first, params, scene);
+				mean.msPerFrame += result.msPerFrame / scenes.size();
+				mean.psnr += result.psnr / scenes.size();
+			}
+			std::cout << "  " << std::setw(10) << std::left << engine.second << std::right
+				<< mean.msPerFrame << " ms per frame, PSNR " << mean.psnr << " dB" << std::endl;
+		}
+	}
+
+	void RunCostModeBenchmark(const std::string& mediaDir)
+	{
+		const std::vector<cv::Mat3b> scenes = LoadScenes(mediaDir);
+		if (scenes.empty()) return;
+
+		const std::pair<inpainting::CostMode, const char*> modes[] = {
+			{ inpainting::CostMode::Rgb, "rgb" },
+			{ inpainting::CostMode::Luma, "luma" },
+			{ inpainting::CostMode::LumaChromaRefine, "refine" }
+		};
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "cost modes, patchmatch, " << frameSize.width << "x" << frameSize.height << ", 60x80 moving hole, mean of " << scenes.size() << " images:" << std::endl;
+		for (const auto& mode : modes)
+		{
+			inpainting::InpaintingParams params;
+			params.seed = 1;
+			params.contextMargin = 64;
+			params.costMode = mode.first;
+
+			EngineResult mean;
+			for (const auto& scene : scenes)
+			{
+				const EngineResult result = RunEngine(inpainting::EngineType::PatchMatch, params, scene);
+				mean.msPerFrame += result.msPerFrame / scenes.size();
+				mean.psnr += result.psnr / scenes.size();
+			}
+			std::cout << "  " << std::setw(10) << std::left << mode.second << std::right
+				<< mean.msPerFrame << " ms per frame, PSNR " << mean.psnr << " dB" << std::endl;
+		}
+	}
+
+	void RunCoarseOnlyBenchmark(const std::string& mediaDir)
+	{
+		const cv::Size size(1280, 720);
+		const std::vector<cv::Mat3b> scenes = LoadScenes(mediaDir, size);
+		if (scenes.empty()) return;
+
+		cv::Mat1b mask(size, uchar(255));
+		mask(cv::Rect(560, 280, 120, 160)).setTo(0);
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "finest optimized level, image, 1280x720, 120x160 hole, mean of " << scenes.size() << " images:" << std::endl;
+		for (int level = 0; level <= 2; ++level)
+		{
+			inpainting::InpaintingParams params;
+			params.seed = 1;
+			params.finestOptimizedLevel = level;
+
+			double ms = 0.0, psnr = 0.0;
+			for (const auto& scene : scenes)
+			{
+				inpainting::ImageInpainter inpainter;
+				inpainter.Init(params);
+				cv::Mat3b inpainted;
+				const int64 start = cv::getTickCount();
+				inpainter.Inpaint(scene, mask, inpainted);
+				ms += 1000.0 * Seconds(cv::getTickCount() - start) / scenes.size();
+				psnr += HolePsnr(scene, inpainted, mask) / scenes.size();
+			}
+			std::cout << "  level " << level << "  " << ms << " ms, PSNR " << psnr << " dB" << std::endl;
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+namespace inpainting_tests
+{
+	// Timings and quality measurements, they only print their results and don't fail. mediaDir holds
+	// the still images (VideoManipulation/media) that the frame based ones pan over.
+
+	// 5x5 patch SSD and the Inpaint() gather on BGRx (level layout) against interleaved BGR.
+	void RunKernelBenchmark();
+
+	// Per-frame time and PSNR inside the holes of PatchMatch for every cost mode.
+	void RunCostModeBenchmark(const std::string& mediaDir);
+
+	// Time and PSNR inside the hole of a 1280x720 image when only levels >= finestOptimizedLevel are
+	// optimized (0, 1 and 2).
+	void RunCoarseOnlyBenchmark(const std::string& mediaDir);
+
+	// Random reads of the nearest neighbour field as cv::Mat2s (int16) and cv::Mat2i at 1280x720.
+	void RunNnfBenchmark();
+
+	// Per-frame time and PSNR inside the holes of every engine, on a fixed camera with a moving hole.
+	void RunEngineBenchmark(const std::string& mediaDir);
+}
@@ -0,0 +1,197 @@
+#include "KernelTest.hpp"
+#include "PatchDistance.hpp"
+#include "Pyramid.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace inpainting_tests
+{
+	static void FillRandom(cv::Mat& mat, std::minstd_rand& rng)
+	{
+		std::uniform_int_distribution<int> byte(0, 255);
+		for (int r = 0; r < mat.rows; ++r)
+		{
+			auto ptr = mat.ptr<uchar>(r);
+			for (size_t c = 0; c < mat.cols * mat.elemSize(); ++c) ptr[c] = uchar(byte(rng));
+		}
+	}
+
+	static bool Check(const std::string& name, int mismatches, int cases)
+	{
+		const bool passed = mismatches == 0;
+		std::cout << (passed ? "[PASS] " : "[FAIL] ") << "kernels, " << name << ": " << mismatches
+			<< " mismatches in " << cases << " cases" << std::endl;
+		return passed;
+	}
+
+	// Both stop after the first row above the limit, so the sums are equal up to that row. Beyond
+	// the limit the exact partial sum doesn't matter to the callers.
+	static bool CheckPatchSsd()
+	{
+		const int numCases = 200000;
+		std::minstd_rand rng(1);
+		cv::Mat4b target(40, 40), ref(40, 40);
+		FillRandom(target, rng);
+		FillRandom(ref, rng);
+		// mostly similar patches, as the search compares them, and the padding byte of both is 255
+		for (int r = 0; r < ref.rows; ++r)
+		{
+			for (int c = 0; c < ref.cols; ++c)
+			{
+				for (int k = 0; k < 3; ++k) ref(r, c)[k] = uchar((ref(r, c)[k] + 7 * target(r, c)[k]) / 8);
+				target(r, c)[3] = ref(r, c)[3] = 255;
+			}
+		}
+
+		const inpainting::PatchSsdFunc patchSsd = inpainting::GetPatchSsd5x5();
+		std::uniform_int_distribution<int> pos(0, 35), limit(0, 5 * 5 * 3 * 255 * 255 / 16);
+		int mismatches = 0;
+		for (int i = 0; i < numCases; ++i)
+		{
+			const uchar* ptrTarget = &target(pos(rng), pos(rng))[0];
+			const uchar* ptrRef = &ref(pos(rng), pos(rng))[0];
+			const int maxSsd = i % 4 == 0 ? INT_MAX : limit(rng);
+			const int expected = inpainting::PatchSsdScalar<5>(ptrTarget, target.step, ptrRef, ref.step, maxSsd);
+			const int ssd = patchSsd(ptrTarget, target.step, ptrRef, ref.step, maxSsd);
+			if (expected <= maxSsd ? ssd != expected : ssd <= maxSsd) mismatches++;
+		}
+		return Check("5x5 patch ssd", mismatches, numCases);
+	}
+
+	// The float appearance cost the integer kernels replaced (per pixel Vec3f dot products).
+	static float PatchCostFloat(const cv::Mat4b& target, const cv::Mat4b& ref, const cv::Point& targetPos, const cv::Point& refPos)
+	{
+		const float w = 1.0f / float(5 * 5);
+		const float normFctor = 255.0f * 255.0f * 3.0f;
+
+		float ac = 0.0f;
+		for (int r = 0; r < 5; ++r)
+		{
+			for (int c = 0; c < 5; ++c)
+			{
+				const cv::Vec4b& t = target(targetPos.y + r, targetPos.x + c);
+				const cv::Vec4b& p = ref(refPos.y + r, refPos.x + c);
+				cv::Vec3f diff(cv::Vec3f(t[0], t[1], t[2]) - cv::Vec3f(p[0], p[1], p[2]));
+				ac += diff.dot(diff);
+			}
+		}
+		return ac * w / normFctor;
+	}
+
+	// The dispatched kernel, normalized and limited as InpaintingLevel::CalcPatchCost does, against
+	// the float cost: equal up to float rounding below the bound, and only terminated early if the
+	// float cost exceeds it as well.
+	static bool CheckPatchCostFloat()
+	{
+		const int numCases = 100000;
+		const float w = 1.0f / float(5 * 5);
+		const float normFctor = 255.0f * 255.0f * 3.0f;
+		std::minstd_rand rng(4);
+		cv::Mat4b target(40, 40), ref(40, 40);
+		FillRandom(target, rng);
+		FillRandom(ref, rng);
+		for (int r = 0; r < ref.rows; ++r)
+		{
+			for (int c = 0; c < ref.cols; ++c)
+			{
+				for (int k = 0; k < 3; ++k) ref(r, c)[k] = uchar((ref(r, c)[k] + 7 * target(r, c)[k]) / 8);
+				target(r, c)[3] = ref(r, c)[3] = 255;
+			}
+		}
+
+		const inpainting::PatchSsdFunc patchSsd = inpainting::GetPatchSsd5x5();
+		std::uniform_int_distribution<int> pos(0, 35);
+		std::uniform_real_distribution<float> bound(0.0f, 1.0f / 16.0f);
+		int mismatches = 0;
+		for (int i = 0; i < numCases; ++i)
+		{
+			const cv::Point targetPos(pos(rng), pos(rng)), refPos(pos(rng), pos(rng));
+			const float maxCost = i % 2 == 0 ? FLT_MAX : bound(rng);
+			const float limitF = maxCost * normFctor / w;
+			const int limit = limitF < float(INT_MAX) ? int(limitF) : INT_MAX;
+			const int ssd = patchSsd(&target(targetPos)[0], target.step, &ref(refPos)[0], ref.step, limit);
+
+			const float expected = PatchCostFloat(target, ref, targetPos, refPos);
+			const float tolerance = 1e-5f * std::max(1.0f, expected);
+			if (ssd <= limit ? std::abs(ssd * w / normFctor - expected) > tolerance : expected < maxCost - tolerance) mismatches++;
+		}
+		return Check("5x5 patch cost against float", mismatches, numCases);
+	}
+
+	static bool CheckLumaSsd()
+	{
+		const int numCases = 200000;
+		std::minstd_rand rng(3);
+		cv::Mat1b target(40, 40), ref(40, 40);
+		FillRandom(target, rng);
+		FillRandom(ref, rng);
+		for (int r = 0; r < ref.rows; ++r)
+		{
+			for (int c = 0; c < ref.cols; ++c) ref(r, c) = uchar((ref(r, c) + 7 * target(r, c)) / 8);
+		}
+
+		const inpainting::PatchSsdFunc lumaSsd = inpainting::GetPatchSsd5x5Luma();
+		std::uniform_int_distribution<int> pos(0, 35), limit(0, 5 * 5 * 255 * 255 / 16);
+		int mismatches = 0;
+		for (int i = 0; i < numCases; ++i)
+		{
+			// the patch in the bottom right corner ends with the buffer
+			const uchar* ptrTarget = i == 0 ? &target(35, 35) : &target(pos(rng), pos(rng));
+			const uchar* ptrRef = i == 0 ? &ref(35, 35) : &ref(pos(rng), pos(rng));
+			const int maxSsd = i % 4 == 0 ? INT_MAX : limit(rng);
+			const int expected = inpainting::PatchSsdScalar<5, 1>(ptrTarget, target.step, ptrRef, ref.step, maxSsd);
+			const int ssd = lumaSsd(ptrTarget, target.step, ptrRef, ref.step, maxSsd);
+			if (expected <= maxSsd ? ssd != expected : ssd <= maxSsd) mismatches++;
+		}
+		return Check("5x5 luma ssd", mismatches, numCases);
+	}
+
+	static bool CheckPyramid()
+	{
+		int mismatches = 0, numCases = 0;
+		std::minstd_rand rng(2);
+		for (const cv::Size size : { cv::Size(67, 45), cv::Size(128, 64), cv::Size(5, 3) })
+		{
+			cv::Mat4b color(size);
+			cv::Mat1b mask(size);
+			FillRandom(color, rng);
+			FillRandom(mask, rng);
+
+			cv::Mat4b colorDown;
+			cv::Mat1b minDown, maxDown;
+			inpainting::PyrDown2x(color, mask, colorDown, minDown);
+			inpainting::MaxPool2x(mask, maxDown);
+			for (int r = 0; r < size.height / 2; ++r)
+			{
+				for (int c = 0; c < size.width / 2; ++c)
+				{
+					const uchar m[4] = { mask(2 * r, 2 * c), mask(2 * r, 2 * c + 1), mask(2 * r + 1, 2 * c), mask(2 * r + 1, 2 * c + 1) };
+					if (minDown(r, c) != *std::min_element(m, m + 4)) mismatches++;
+					if (maxDown(r, c) != *std::max_element(m, m + 4)) mismatches++;
+					for (int k = 0; k < 4; ++k)
+					{
+						const int sum = color(2 * r, 2 * c)[k] + color(2 * r, 2 * c + 1)[k] + color(2 * r + 1, 2 * c)[k] + color(2 * r + 1, 2 * c + 1)[k];
+						if (colorDown(r, c)[k] != (sum + 2) / 4) mismatches++;
+					}
+					numCases++;
+				}
+			}
+		}
+		return Check("2x2 pyramid pooling", mismatches, numCases);
+	}
+
+	bool RunKernelTest()
+	{
+		bool passed = CheckPatchSsd();
+		passed &= CheckPatchCostFloat();
+		passed &= CheckLumaSsd();
+		passed &= CheckPyramid();
+		return passed;
+	}
+}
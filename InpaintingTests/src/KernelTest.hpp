@@ -0,0 +1,9 @@
+#pragma once
+
+namespace inpainting_tests
+{
+	// Compares the vectorized kernels with their scalar definitions on random data: the 5x5 patch
+	// SSD on color and luma (with early termination), the normalized color cost against the float
+	// cost it replaced and the 2x2 pooling of the pyramid.
+	bool RunKernelTest();
+}
@@ -0,0 +1,33 @@
+#include "AllocationTest.hpp"
+#include "Benchmarks.hpp"
+#include "KernelTest.hpp"
+#include "TilingTest.hpp"
+
+#include <iostream>
+#include <string>
+
+// Checks of the inpainting library, the exit code is the number of failed checks.
+// "--benchmark [media directory]" additionally prints the timings, the frame based ones run on the
+// images of VideoManipulation/media by default.
+int main(int argc, char * argv[])
+{
+	const bool benchmark = argc > 1 && std::string(argv[1]) == "--benchmark";
+	const std::string mediaDir = argc > 2 ? argv[2] : "../VideoManipulation/media";
+
+	int failed = 0;
+	if (!inpainting_tests::RunKernelTest()) failed++;
+	if (!inpainting_tests::RunAllocationTest()) failed++;
+	if (!inpainting_tests::RunTilingTest()) failed++;
+
+	if (benchmark)
+	{
+		inpainting_tests::RunKernelBenchmark();
+		inpainting_tests::RunNnfBenchmark();
+		inpainting_tests::RunEngineBenchmark(mediaDir);
+		inpainting_tests::RunCostModeBenchmark(mediaDir);
+		inpainting_tests::RunCoarseOnlyBenchmark(mediaDir);
+	}
+
+	std::cout << (failed == 0 ? "all checks passed" : "checks failed") << std::endl;
+	return failed;
+}
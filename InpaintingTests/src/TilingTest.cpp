@@ -0,0 +1,101 @@
+#include "TilingTest.hpp"
+#include "ImageInpainter.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace inpainting_tests
+{
+	static const cv::Size imageSize(320, 240);
+	static const cv::Rect hole(80, 70, 160, 100);
+	static const cv::Vec3b marker(255, 0, 255);	// the texture never reaches 0 or 255
+	static const double maxPsnrLoss = 3.0;	// dB the tiles may lose against the whole image
+
+	// periodic stripes, which PatchMatch continues well from any part of the image
+	static cv::Mat3b MakeTexture()
+	{
+		cv::Mat3b texture(imageSize);
+		const double pi = 3.14159265358979;
+		for (int r = 0; r < texture.rows; ++r)
+		{
+			for (int c = 0; c < texture.cols; ++c)
+			{
+				const double x = 60.0 * std::sin(2.0 * pi * c / 16.0), y = 40.0 * std::cos(2.0 * pi * r / 12.0);
+				texture(r, c) = cv::Vec3b(cv::saturate_cast<uchar>(128.0 + x + y), cv::saturate_cast<uchar>(128.0 + x - y),
+					cv::saturate_cast<uchar>(128.0 - x + y / 2.0));
+			}
+		}
+		return texture;
+	}
+
+	static double HolePsnr(const cv::Mat3b& truth, const cv::Mat3b& result)
+	{
+		double sse = 0.0;
+		for (int r = hole.y; r < hole.y + hole.height; ++r)
+		{
+			for (int c = hole.x; c < hole.x + hole.width; ++c)
+			{
+				for (int k = 0; k < 3; ++k)
+				{
+					const double diff = double(truth(r, c)[k]) - double(result(r, c)[k]);
+					sse += diff * diff;
+				}
+			}
+		}
+		if (sse == 0.0) return 99.0;
+		return 10.0 * std::log10(255.0 * 255.0 * 3.0 * hole.area() / sse);
+	}
+
+	static cv::Mat3b Inpaint(inpainting::InpaintingParams params, const cv::Mat3b& color, const cv::Mat1b& mask)
+	{
+		inpainting::ImageInpainter inpainter;
+		inpainter.Init(params);
+		cv::Mat3b inpainted;
+		inpainter.Inpaint(color, mask, inpainted);
+		return inpainted;
+	}
+
+	static bool Check(const std::string& name, bool passed, const std::string& detail)
+	{
+		std::cout << (passed ? "[PASS] " : "[FAIL] ") << "tiling, " << name << ": " << detail << std::endl;
+		return passed;
+	}
+
+	bool RunTilingTest()
+	{
+		const cv::Mat3b truth = MakeTexture();
+		cv::Mat1b mask(imageSize, uchar(255));
+		mask(hole).setTo(0);
+		cv::Mat3b color = truth.clone();
+		color(hole) = marker;
+
+		inpainting::InpaintingParams params;
+		params.seed = 1;
+		const cv::Mat3b whole = Inpaint(params, color, mask);
+
+		// about 60x60 pixel tiles with the default halo, several of them deep inside the hole
+		inpainting::InpaintingParams tiledParams = params;
+		tiledParams.tileMemoryBudget = 1 << 20;
+		const cv::Mat3b tiled = Inpaint(tiledParams, color, mask);
+
+		int unfilled = 0, changed = 0;
+		const cv::Rect band(hole.x - params.blurSize, hole.y - params.blurSize, hole.width + 2 * params.blurSize, hole.height + 2 * params.blurSize);
+		for (int r = 0; r < imageSize.height; ++r)
+		{
+			for (int c = 0; c < imageSize.width; ++c)
+			{
+				if (hole.contains(cv::Point(c, r))) unfilled += tiled(r, c) == marker ? 1 : 0;
+				else if (!band.contains(cv::Point(c, r))) changed += tiled(r, c) != color(r, c) ? 1 : 0;
+			}
+		}
+
+		bool passed = Check("filled", unfilled == 0, std::to_string(unfilled) + " of " + std::to_string(hole.area()) + " hole pixels unfilled");
+		passed &= Check("untouched", changed == 0, std::to_string(changed) + " pixels outside the blending band changed");
+
+		const double psnrWhole = HolePsnr(truth, whole), psnrTiled = HolePsnr(truth, tiled);
+		passed &= Check("quality", psnrTiled >= psnrWhole - maxPsnrLoss, "hole PSNR " + std::to_string(psnrTiled)
+			+ " dB tiled, " + std::to_string(psnrWhole) + " dB whole (at most " + std::to_string(maxPsnrLoss) + " dB less)");
+		return passed;
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+namespace inpainting_tests
+{
+	// Inpaints a large hole in a synthetic texture once as a whole and once tile by tile under a small
+	// tileMemoryBudget. The tiles have to fill every hole pixel, leave the rest of the image alone and
+	// stay within a tolerance of the untiled quality.
+	bool RunTilingTest();
+}
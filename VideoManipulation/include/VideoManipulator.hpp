@@ -1,6 +1,6 @@
 #pragma once
 #include "Detector.hpp"
-#include "VideoInpainter.hpp"
+#include "InpaintingEngine.hpp"
 #include "Streamer.hpp"
 #include "Utilities.hpp"
 
@@ -42,6 +42,7 @@ namespace vm {
 		std::string maskPath;
 		std::string templateSrcPath;
 		std::string templateMaskSrcPath;
+		inpainting::EngineType engine = inpainting::EngineType::PatchMatch;
 	};
 
 	class VideoManipulator
@@ -88,7 +89,7 @@ namespace vm {
 
 		stream::GStreamer streamer;
 		object_detection::Detector detector;
-		inpainting::VideoInpainter inpainter;
+		std::unique_ptr<inpainting::InpaintingEngine> inpainter;
 
 		bool ValidateParams(ManipulationParams& parameters);
 		void InitGStreamer(ManipulationParams& parameters);
@@ -67,12 +67,18 @@ namespace vm
 		else
 		{
 			manipulationMethod = ManipulationMethod::Inpainting;
+			inpainter = inpainting::CreateEngine(parameters.engine);
 			inpainting::InpaintingParams inpaintParams;
 			inpaintParams.alpha = 0.15f;			// 0.0f means no spatial cost considered
 			inpaintParams.beta = 0.99f;			    // 0.0f means no coherence cost considered
 			inpaintParams.maxItr = 1;				// set to 1 to crank up the speed
 			inpaintParams.maxRandSearchItr = 1;	// set to 1 to crank up the speed
-			inpainter.Init(inpaintParams);
+			inpaintParams.contextMargin = 64;		// only inpaint around the detections, -1 for the whole frame
+			inpaintParams.motionCompensation = true;	// follow the camera motion with the temporal state
+			inpaintParams.splitComponents = true;	// inpaint separate detections concurrently
+			inpaintParams.backgroundPlate = true;	// fill what was visible a few frames ago from history
+			inpaintParams.resultCache = maskSrcType == MaskSourceType::File;	// a fixed mask on a still scene reuses the last fill
+			inpainter->Init(inpaintParams);
 		}
 
 		pathToTemplateMask = parameters.templateMaskSrcPath;
@@ -109,6 +115,7 @@ namespace vm
 		const std::string height = "height=";
 		const std::string templateSrc = "template=";
 		const std::string templateMaskSrc = "templateMask=";
+		const std::string engine = "engine=";
 
 		for (int i = 0; i < argc; ++i)
 		{
@@ -122,6 +129,8 @@ namespace vm
 			if (arg.rfind(height, 0)) parameters.dimensions.height = std::stoi(arg.substr(height.length()));
 			if (arg.rfind(templateSrc, 0)) parameters.templateSrcPath = arg.substr(templateSrc.length());
 			if (arg.rfind(templateMaskSrc, 0)) parameters.templateMaskSrcPath = arg.substr(templateMaskSrc.length());
+			if (arg.rfind(engine, 0) == 0 && !inpainting::ParseEngineType(arg.substr(engine.length()), parameters.engine))
+				std::cout << "[WARNING]: Unknown inpainting engine '" << arg.substr(engine.length()) << "', using patchmatch (telea, ns, temporal)" << std::endl;
 		}
 
 		return Init(parameters);
@@ -292,7 +301,7 @@ namespace vm
 		else
 		{
 			auto start = std::chrono::steady_clock::now();
-			inpainter.Inpaint(img, mask, manipulated);
+			inpainter->Inpaint(img, mask, manipulated);
 			auto end = std::chrono::steady_clock::now();
 			auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 